@@ -8,7 +8,13 @@
 #include <iostream>
 
 #include "shaders.h"
+#include "shadervariants.h"
+#include "glstate.h"
 #include "camera.h"
+#include "frameconstants.h"
+#include "fixedstep.h"
+#include "instancing.h"
+#include "cubeprogram.h"
 
 //2)
 #define SCREEN_H 800
@@ -30,8 +36,14 @@ float lastY = SCREEN_W/2.0f;
 bool firstMouse = true;
 
 //25)
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
+// the simulation (camera movement, cube rotation) advances in fixed steps, independent of the frame rate
+FixedStepClock simulation(SIMULATION_HZ);
+
+// mouse and scroll movement since the last step: the callbacks run during glfwPollEvents, so they only add up
+// here and the next step applies it, or frames without a step would interpolate toward a half-turned camera
+float pendingX = 0.0f;
+float pendingY = 0.0f;
+float pendingScroll = 0.0f;
 
 //26)
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
@@ -44,19 +56,18 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
         lastY = ypos;
         firstMouse = false;
     }   
-    float xoffset = xpos - lastX;
-    float yoffset = lastY - ypos;
+    pendingX += xpos - lastX;
+    pendingY += lastY - ypos;
     lastX = xpos;
     lastY = ypos;
-    camera.ProcessMouseMovement(xoffset, yoffset);
 }
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
-    camera.ProcessMouseScroll(static_cast<float>(yoffset));
+    pendingScroll += static_cast<float>(yoffset);
 }
 
 //27)
-void processInput(GLFWwindow *window)
+void processInput(GLFWwindow *window, float deltaTime)
 {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
@@ -102,10 +113,13 @@ int main()
     }
 
     //5)
-    glEnable(GL_DEPTH_TEST);
+    GLStateCache::enable(GL_DEPTH_TEST);
 
     //6)
-    Shader ourShader("04Abstraction/vertex.vs","04Abstraction/fragment.fs");
+    // the INSTANCED variant: the model matrix is a per-instance input instead of a uniform (instancing.glsl)
+    ShaderVariants cubeVariants("04Abstraction/vertex.vs","04Abstraction/fragment.fs");
+    Shader &ourShader = cubeVariants.get(SHADER_INSTANCED);
+    std::cout << "shader ready in " << ourShader.buildMilliseconds << " ms (" << (ourShader.loadedFromCache ? "binary cache" : "compiled from source") << ")" << std::endl;
 
     //7)
     float vertices[] = {
@@ -158,10 +172,10 @@ int main()
     glGenBuffers(1, &VBO);
 
     //11)
-    glBindVertexArray(VAO);
+    GLStateCache::bindVertexArray(VAO);
 
     //12)
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    GLStateCache::bindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
     //14)
@@ -171,13 +185,16 @@ int main()
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)(6*sizeof(float)));
     glEnableVertexAttribArray(2);    
+    // the cubes' model matrices, one per instance
+    InstanceBuffer cubeInstances;
+    cubeInstances.attach();
 
     //15)
     unsigned int texture1;
     glGenTextures(1, &texture1);
 
     //16)
-    glBindTexture(GL_TEXTURE_2D, texture1);
+    GLStateCache::bindTexture(GL_TEXTURE_2D, texture1);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);  
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -202,8 +219,19 @@ int main()
     stbi_image_free(data);
 
     //21)
-    ourShader.use();
-    ourShader.setInt("texture1", 0);
+    // the generated interface resolves the uniforms and points the sampler at its unit once
+    CubeProgram program(ourShader);
+    double lastReport = 0.0;
+
+    // one uniform buffer feeds view/projection to every program that declares the FrameConstants block
+    FrameConstantsBuffer frameConstants;
+    camera.SetPerspective((float)SCREEN_W/SCREEN_H, 0.1f, 100.0f);
+    // frames are drawn between the last two simulated states: the camera simulated one step earlier, and one
+    // moved between it and the current camera
+    Camera previousCamera = camera;
+    Camera renderCamera = camera;
+    // the C++ layout of the block is checked against the linked program once; mismatches are printed
+    FrameConstantsBuffer::matches(ourShader);
 
     //22)
     glm::vec3 cubePositions[] = 
@@ -224,34 +252,43 @@ int main()
     while (!glfwWindowShouldClose(window)) 
     {
         //a)
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame-lastFrame;
-        lastFrame = currentFrame;
+        double currentFrame = glfwGetTime();
+        unsigned int steps = simulation.advance(currentFrame);
+        Shader::resetFrameStats();
+        GLStateCache::resetFrameStats();
 
         //b)
         glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         //c)
-        glm::mat4 view(1.0f);
-        view =  camera.GetViewMatrix();
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCREEN_W/SCREEN_H, 0.1f, 100.0f);
+        // the projection now lives in the camera, which rebuilds it only when Zoom changes
 
         //d)
-        ourShader.use();
-        ourShader.setMat4("view", view);
-        ourShader.setMat4("projection", projection);
+        glfwPollEvents();
+        for (unsigned int step = 0; step < steps; step++)
+        {
+            previousCamera = camera;
+            processInput(window, (float)simulation.step());
+            if (step == 0)
+            {
+                camera.ProcessMouseMovement(pendingX, pendingY);
+                camera.ProcessMouseScroll(pendingScroll);
+                pendingX = pendingY = pendingScroll = 0.0f;
+            }
+        }
+        renderCamera.Interpolate(previousCamera, camera, (float)simulation.alpha());
 
         //e)
-        processInput(window);
-        glfwPollEvents();
+        double time = simulation.renderTime();
+        frameConstants.write(renderCamera, (float)time);
+        program.use();
 
         //f)
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture1);
+        GLStateCache::bindTextureUnit(CubeProgram::ourTextureUnit, GL_TEXTURE_2D, texture1);
 
         //g)
-        glBindVertexArray(VAO);
+        glm::mat4 cubeModels[10];
 
         //h)
         for (unsigned int i = 0; i < 10; ++i)
@@ -259,24 +296,34 @@ int main()
             //i)
             glm::mat4 model(1.0f);
             model = glm::translate(model, glm::vec3(cubePositions[i]));
-            float angle = glfwGetTime()*(70.0f)*(i+1);
+            float angle = (float)(time*(70.0)*(i+1));
             model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f,1.0f,1.0f));
 
             //ii)
-            ourShader.use();
-            ourShader.setMat4("model", model);
-
-            //iii)            
-            glDrawArrays(GL_TRIANGLES, 0, 36);
-
+            cubeModels[i] = model;
         }
+
+        //iii)
+        // all ten cubes in one instanced draw, their matrices streamed in one upload
+        cubeInstances.drawArrays(VAO, GL_TRIANGLES, 0, 36, cubeModels, 10);
         //i)
+        if (currentFrame - lastReport >= 1.0)
+        {
+            const ShaderStats &stats = Shader::frameStats();
+            std::cout << "uniform lookups avoided this frame: " << stats.lookupsAvoided() << " (by name: " << stats.nameWrites << ", location queries: " << stats.locationQueries << ")" << std::endl;
+            const UniformUploadStats &uploads = ourShader.uploadStats();
+            std::cout << "uniform uploads skipped this frame: " << stats.skippedUploads << " (program total: " << uploads.skippedCalls << " calls, " << uploads.skippedBytes << " bytes skipped, " << uploads.uploads << " uploaded)" << std::endl;
+            std::cout << "GL state calls this frame: " << GLStateCache::frameStats().issued << " issued, " << GLStateCache::frameStats().elided << " elided" << std::endl;
+            lastReport = currentFrame;
+        }
+        frameConstants.endFrame();
         glfwSwapBuffers(window);   
     }
 
     //29)
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &cubeInstances.buffer);
     glfwTerminate();
     return 0;
 }
@@ -0,0 +1,61 @@
+// Generated by tools/shadergen.cpp from 04Abstraction/vertex.vs and 04Abstraction/fragment.fs; do not edit.
+// After changing the GLSL, rerun ./shadergen tools/shaderprograms.txt from the repository root.
+
+#ifndef CUBE_PROGRAM_H
+#define CUBE_PROGRAM_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <shaders.h>
+
+// typed interface of the Cube program: the handles are resolved once per link, so nothing
+// in the draw path spells or hashes a uniform name
+class CubeProgram
+{
+public:
+    // vertex inputs, from their layout (location = N) qualifiers
+    static const GLuint aPosLocation = 0;
+    static const GLuint aColorLocation = 1;
+    static const GLuint aTexCoordLocation = 2;
+    // bit N for every vertex attribute above (locations below 7, VertexAttribute in vertexformat.h); meshes
+    // built for this program can leave the other attributes out
+    static const unsigned int attributeMask = 0x7;
+    // texture unit of each sampler: material textures on their role's unit (textureroles.h), the others in
+    // declaration order after those; bind() points the samplers at them
+    static const GLuint ourTextureUnit = 8;
+
+    Shader &shader;
+
+    explicit CubeProgram(Shader &shader) : shader(shader)
+    {
+        bind();
+    }
+
+    // activates the program, resolving the handles again first if it was rebuilt (see ShaderWatcher)
+    void use()
+    {
+        if (generation != shader.generation)
+            bind();
+        shader.use();
+    }
+    void setModel(const glm::mat4 &value) const
+    {
+        shader.setMat4(model, value);
+    }
+
+private:
+    unsigned int generation;
+    UniformHandle<glm::mat4> model;
+    UniformHandle<int> ourTexture;
+
+    void bind()
+    {
+        generation = shader.generation;
+        model = shader.uniform<glm::mat4>("model");
+        ourTexture = shader.uniform<int>("ourTexture");
+        shader.use();
+        shader.setInt(ourTexture, ourTextureUnit);
+    }
+};
+#endif
@@ -4,16 +4,15 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aColor;
 layout (location = 2) in vec2 aTexCoord;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "instancing.glsl"
+#include "frameconstants.glsl"
 
 out vec3 ourColor;
 out vec2 TexCoord;
     
 void main()
 {
-    gl_Position = projection*view*model*vec4(aPos, 1.0);
+    gl_Position = viewProj*modelMatrix()*vec4(aPos, 1.0);
     ourColor = aColor;
     TexCoord = aTexCoord;
 }
\ No newline at end of file
@@ -6,10 +6,23 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
 
 #include "shaders.h"
+#include "glstate.h"
+#include "shaderlibrary.h"
+#include "shadervariants.h"
+#include "shaderwatcher.h"
 #include "camera.h"
+#include "inputqueue.h"
+#include "frameconstants.h"
+#include "fixedstep.h"
 #include "model.h"
+#include "modelprogram.h"
+#include "allocationcounter.h"
+#include "memoryusage.h"
 
 
 //2)
@@ -32,8 +45,12 @@ float lastY = SCREEN_W/2.0f;
 bool firstMouse = true;
 
 //25)
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
+// the simulation (camera movement, model rotation) advances in fixed steps, independent of the frame rate
+FixedStepClock simulation(SIMULATION_HZ);
+
+// the callbacks only queue input; the simulation applies it to the camera once per step, which is also where it
+// is recorded (--record file) or replaced by a recording (--replay file), so a replay is exact at any frame rate
+InputQueue input;
 
 //26)
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
@@ -50,30 +67,85 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
     float yoffset = lastY - ypos;
     lastX = xpos;
     lastY = ypos;
-    camera.ProcessMouseMovement(xoffset, yoffset);
+    input.push(INPUT_MOUSE_MOVE, 0, xoffset, yoffset);
 }
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
-    camera.ProcessMouseScroll(static_cast<float>(yoffset));
+    input.push(INPUT_SCROLL, 0, 0.0f, static_cast<float>(yoffset));
 }
 
 //27)
-void processInput(GLFWwindow *window)
+void processInput(GLFWwindow *window, float deltaTime)
 {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.ProcessKeyboard(FORWARD, deltaTime);
+        input.push(INPUT_MOVE, FORWARD, deltaTime, 0.0f);
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
+        input.push(INPUT_MOVE, BACKWARD, deltaTime, 0.0f);
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.ProcessKeyboard(LEFT, deltaTime);
+        input.push(INPUT_MOVE, LEFT, deltaTime, 0.0f);
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.ProcessKeyboard(RIGHT, deltaTime);
+        input.push(INPUT_MOVE, RIGHT, deltaTime, 0.0f);
 }
 
-int main()
+int main(int argc, char **argv)
 {
+    //0)
+    // --vertex-format float|half|unorm16 picks the format the model is uploaded in; only the attributes the program
+    // declares are uploaded, with the positions in a stream of their own for depth-only passes.
+    // --multi-draw base-vertex submits with glMultiDrawElementsBaseVertex even where multi-draw indirect is available.
+    // --instances N draws N fish in a grid, as one instanced draw per mesh or, with --instance-draw loop, as one
+    // Model::Draw per fish; with --replay the ms per frame printed at exit compares the two
+    // --residency keep|release|positions picks what the meshes keep in RAM after their upload; nothing here reads
+    // the CPU copies, so by default they are released
+    // --meshlets off draws whole meshes culled by their bounds instead of the meshlets that face the camera and
+    // touch the frustum
+    // --lod off loads and draws full detail only; otherwise each fish (each instance) is drawn at the coarsest level
+    // whose error stays under --lod-threshold pixels (default 1)
+    unsigned int instanceCount = 0;
+    MeshResidency residency = MESH_RELEASE_CPU_COPY;
+    bool meshletCulling = true;
+    bool lodSelection = true;
+    float lodThreshold = 1.0f;
+    bool instancedDraw = true;
+    VertexLayout vertexLayout;
+    vertexLayout.format = VERTEX_FORMAT_UNORM16;
+    vertexLayout.attributes = ModelProgram::attributeMask;
+    vertexLayout.splitPositions = true;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        std::string option = argv[i];
+        if ((option == "--record" && !input.record(argv[i + 1])) || (option == "--replay" && !input.replay(argv[i + 1])))
+            return -1;
+        if (option == "--vertex-format")
+        {
+            std::string name = argv[i + 1];
+            for (unsigned int f = 0; f < sizeof(VERTEX_FORMAT_NAMES)/sizeof(VERTEX_FORMAT_NAMES[0]); f++)
+                if (name == VERTEX_FORMAT_NAMES[f])
+                    vertexLayout.format = (VertexFormat)f;
+        }
+        if (option == "--instances")
+            instanceCount = (unsigned int)std::strtoul(argv[i + 1], NULL, 10);
+        if (option == "--instance-draw")
+            instancedDraw = std::string(argv[i + 1]) != "loop";
+        if (option == "--residency")
+        {
+            std::string name = argv[i + 1];
+            for (unsigned int r = 0; r < sizeof(MESH_RESIDENCY_NAMES)/sizeof(MESH_RESIDENCY_NAMES[0]); r++)
+                if (name == MESH_RESIDENCY_NAMES[r])
+                    residency = (MeshResidency)r;
+        }
+        if (option == "--lod")
+            lodSelection = std::string(argv[i + 1]) != "off";
+        if (option == "--lod-threshold")
+            lodThreshold = (float)std::atof(argv[i + 1]);
+        if (option == "--meshlets")
+            meshletCulling = std::string(argv[i + 1]) != "off";
+        if (option == "--multi-draw")
+            DrawBatch::shared().allowIndirect = std::string(argv[i + 1]) != "base-vertex";
+    }
+
     //1)
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -104,53 +176,225 @@ int main()
     }
 
     //5)
-    glEnable(GL_DEPTH_TEST);
+    GLStateCache::enable(GL_DEPTH_TEST);
+    // back faces only show through the odd gap in the fish, and the meshlets' cone test drops them anyway
+    GLStateCache::enable(GL_CULL_FACE);
 
     //6)
-    Shader ourShader("05Models/vertex.vs","05Models/fragment.fs");
+    // submit every program first so the driver compiles them while the model loads. The material's features are
+    // only known once it has loaded, so the variants submitted are those the vertex layout alone decides
+    ShaderLibrary shaders((GLADloadproc)glfwGetProcAddress);
+    ShaderVariants modelVariants("05Models/vertex.vs","05Models/fragment.fs");
+    unsigned int layoutFeatures = vertexLayout.format != VERTEX_FORMAT_FLOAT ? SHADER_PACKED_VERTICES : 0;
+    shaders.add("model", modelVariants, layoutFeatures);
+    shaders.add("model instanced", modelVariants, layoutFeatures | SHADER_INSTANCED);
+
+    double loadStart = shaders.elapsed();
+    MemoryUsage memoryBefore = processMemoryUsage();
+    Model ourModel("models/fish/fish.obj", false, vertexLayout, MESH_OPTIMIZE_ALL | (lodSelection ? MESH_GENERATE_LODS : 0), residency);
+    shaders.record("load models/fish/fish.obj", loadStart, shaders.elapsed());
+    // the peak includes the importer's scene and the meshes' arrays before the residency dropped them
+    MemoryUsage memoryLoaded = processMemoryUsage();
+
+    shaders.waitAll();
+    shaders.printTimeline();
+    // the programs this material needs: the ones already submitted unless it has maps the shaders test (a
+    // specular map, say), whose variants compile here
+    Shader &ourShader = modelVariants.get(ourModel.features());
+    if (!ourShader.ready())
+    {
+        printf("Failed to build the model shader");
+        glfwTerminate();
+        return -1;
+    }
+    Shader *instancedShader = &modelVariants.get(ourModel.features() | SHADER_INSTANCED);
+    if (!instancedShader->ready())
+        instancedShader = NULL;
+    std::cout << "shader variants compiled: " << ShaderVariants::compiledVariants() << " (features used by the sources: 0x" << std::hex << modelVariants.usedFeatures << std::dec << ")" << std::endl;
+    if (instanceCount && !instancedShader)
+        instancedDraw = false;
+    // every index fetches one vertex before the post-transform cache, so per draw of the whole model the vertex
+    // fetch is bounded by index count * stride
+    size_t indexCount = 0;
+    for (unsigned int i = 0; i < ourModel.meshes.size(); i++)
+        indexCount += ourModel.meshes[i].lods[0].indexCount;
+    unsigned int stride = vertexStride(vertexLayout.format, vertexLayout.attributes);
+    unsigned int depthStride = vertexStride(vertexLayout.format, VERTEX_POSITION);
+    std::cout << "vertex format " << VERTEX_FORMAT_NAMES[vertexLayout.format] << ": " << stride << " bytes per vertex, vertex buffers " << ourModel.vertexBufferBytes() / 1024 << " KB (every attribute as float: " << ourModel.vertexBufferBytes(VERTEX_FORMAT_FLOAT) / 1024 << " KB), vertex fetch per draw up to " << indexCount * stride / 1024 << " KB (float: " << indexCount * sizeof(Vertex) / 1024 << " KB), per depth-only draw " << indexCount * depthStride / 1024 << " KB" << std::endl;
+    std::cout << "vertex cache (" << VERTEX_CACHE_SIZE << "-entry FIFO): ACMR " << ourModel.cacheBefore.acmr() << " -> " << ourModel.cacheAfter.acmr() << ", ATVR " << ourModel.cacheBefore.atvr() << " -> " << ourModel.cacheAfter.atvr() << std::endl;
+    GeometryArenaStats arena = GeometryArena::shared().stats();
+    std::cout << "geometry arena: " << arena.ranges << " meshes in " << arena.pools << " pools, vertices " << arena.vertexBytesUsed / 1024 << " of " << arena.vertexBytes / 1024 << " KB, indices " << arena.indexBytesUsed / 1024 << " of " << arena.indexBytes / 1024 << " KB" << std::endl;
+    std::cout << "index buffers " << ourModel.indexBufferBytes() / 1024 << " KB (32-bit: " << indexCount * sizeof(unsigned int) / 1024 << " KB)" << std::endl;
+    std::cout << "resident memory: " << memoryBefore.residentBytes / 1024 << " KB before loading, peak " << memoryLoaded.peakBytes / 1024 << " KB, " << memoryLoaded.residentBytes / 1024 << " KB after; CPU geometry kept (" << MESH_RESIDENCY_NAMES[residency] << "): " << ourModel.cpuGeometryBytes() / 1024 << " KB" << std::endl;
+    std::cout << "shader ready in " << ourShader.buildMilliseconds << " ms (" << (ourShader.loadedFromCache ? "binary cache" : "compiled from source") << ")" << std::endl;
+
+    // one uniform buffer feeds view/projection to every program that declares the FrameConstants block
+    FrameConstantsBuffer frameConstants;
+    camera.SetPerspective((float)SCREEN_W/SCREEN_H, 0.1f, 100.0f);
+    // the fish is drawn at a third of its size; with the window's height and the camera's zoom that gives the
+    // distance from which each level is used, i.e. the triangles drawn against distance
+    const float modelScale = 0.3f;
+    for (unsigned int i = 0; i < ourModel.meshes.size(); i++)
+        for (unsigned int level = 0; level < ourModel.meshes[i].lods.size(); level++)
+        {
+            const MeshLod &lod = ourModel.meshes[i].lods[level];
+            std::cout << "mesh " << i << " LOD " << level << ": " << lod.indexCount / 3 << " triangles, error " << lod.error << ", drawn from " << lod.error * modelScale * lodProjectionScale(camera.Zoom, (float)SCREEN_H) / lodThreshold << " units away" << std::endl;
+        }
+    // the C++ layout of the block is checked against the linked program once; mismatches are printed
+    FrameConstantsBuffer::matches(ourShader);
+    // frames are drawn between the last two simulated states: the camera simulated one step earlier, and one
+    // moved between it and the current camera
+    Camera previousCamera = camera;
+    Camera renderCamera = camera;
+    Interpolated<float> modelAngle(0.0f);
+
+    // the generated interface resolves the uniforms once; the render loop never builds or looks up a name
+    ModelProgram program(ourShader);
+    // the instances stand on a square grid behind the single fish's spot; their transforms are rebuilt every frame
+    // so the benchmark pays for streaming them
+    unsigned int gridSide = (unsigned int)std::ceil(std::sqrt((double)instanceCount));
+    std::vector<glm::vec3> instanceOffsets(instanceCount);
+    for (unsigned int i = 0; i < instanceCount; i++)
+        instanceOffsets[i] = glm::vec3(((float)(i % gridSide) - gridSide * 0.5f) * 3.0f, 0.0f, -(float)(i / gridSide) * 3.0f);
+    std::vector<glm::mat4> instanceModels(instanceCount);
+    double lastReport = 0.0;
+    unsigned int framesDrawn = 0;
+    double loopStart = glfwGetTime();
 
-    Model ourModel("models/fish/fish.obj");
+    // edit 05Models/*.vs|fs (or anything they include) while running and the program is swapped in live
+    ShaderWatcher watcher;
+    watcher.watch(ourShader);
+    if (instancedShader)
+        watcher.watch(*instancedShader);
     
     while (!glfwWindowShouldClose(window)) 
     {
         //a)
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame-lastFrame;
-        lastFrame = currentFrame;
+        double currentFrame = glfwGetTime();
+        unsigned int steps = simulation.advance(currentFrame);
+        Shader::resetFrameStats();
+        GLStateCache::resetFrameStats();
+
+        // swap in reloaded programs at the frame boundary; program.use() re-resolves the handles after a swap
+        watcher.update();
 
         //b)
         glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         //c)
-        glm::mat4 view(1.0f);
-        view =  camera.GetViewMatrix();
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCREEN_W/SCREEN_H, 0.1f, 100.0f);
+        // the projection now lives in the camera, which rebuilds it only when Zoom changes
 
         //d)
-        ourShader.use();
-        ourShader.setMat4("view", view);
-        ourShader.setMat4("projection", projection);
+        glfwPollEvents();
+        for (unsigned int step = 0; step < steps; step++)
+        {
+            previousCamera = camera;
+            modelAngle.push();
+            processInput(window, (float)simulation.step());
+            input.consume([](const InputEvent &event) { applyToCamera(event, camera); });
+            modelAngle.current += (float)(50.0 * simulation.step());
+        }
+        if (input.replayFinished())
+            glfwSetWindowShouldClose(window, true);
+        renderCamera.Interpolate(previousCamera, camera, (float)simulation.alpha());
 
         //e)
-        processInput(window);
-        glfwPollEvents();
+        frameConstants.write(renderCamera, (float)simulation.renderTime());
+        program.use();
 
         //h)
         glm::mat4 model(1.0f);
         model = glm::translate(model, glm::vec3(glm::vec3(0.0f,0.0f,5.0f)));
-        model = glm::scale(model, glm::vec3(glm::vec3(0.3f)));
-        float angle = glfwGetTime()*50.0f;
+        model = glm::scale(model, glm::vec3(modelScale));
+        float angle = modelAngle.at(simulation.alpha());
         model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f,1.0f,0.0f));
         model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f,0.0f,0.0f));
         model = glm::rotate(model, glm::radians(angle), glm::vec3(0.0f,0.0f,1.0f));
-        ourShader.setMat4("model", model);
-
-        ourModel.Draw(ourShader);
+        // heap allocations made by the draw calls below; after the first frames have sized the scratch space this
+        // stays 0
+        AllocationScope drawAllocations;
+        unsigned int meshesDrawn = 0;
+        MeshletCullStats meshlets;
+        size_t trianglesDrawn = 0;
+        float projectionScale = lodProjectionScale(renderCamera.Zoom, (float)SCREEN_H);
+        if (instanceCount == 0 && lodSelection)
+            ourModel.SelectLods(model, renderCamera.Position, projectionScale, lodThreshold);
+        if (instanceCount == 0 && meshletCulling)
+        {
+            program.setModel(model);
+            // clusters outside the view frustum or facing away are skipped on the CPU
+            meshlets = ourModel.DrawMeshlets(ourShader, renderCamera.GetViewProjectionMatrix(), renderCamera.Position, model);
+            meshesDrawn = meshlets.calls;
+        }
+        else if (instanceCount == 0)
+        {
+            program.setModel(model);
+            // meshes outside the view frustum are skipped on the CPU
+            meshesDrawn = ourModel.Draw(ourShader, renderCamera.GetFrustum(), model);
+        }
+        else
+        {
+            for (unsigned int i = 0; i < instanceCount; i++)
+                instanceModels[i] = glm::translate(glm::mat4(1.0f), instanceOffsets[i]) * model;
+            if (instancedDraw)
+            {
+                instancedShader->use();
+                if (lodSelection)
+                    trianglesDrawn = ourModel.DrawInstanced(*instancedShader, instanceModels.data(), instanceModels.size(), renderCamera.Position, projectionScale, lodThreshold);
+                else
+                {
+                    ourModel.DrawInstanced(*instancedShader, instanceModels);
+                    for (unsigned int i = 0; i < ourModel.meshes.size(); i++)
+                        trianglesDrawn += instanceCount * (ourModel.meshes[i].lods[0].indexCount / 3);
+                }
+            }
+            else
+                for (unsigned int i = 0; i < instanceCount; i++)
+                {
+                    program.setModel(instanceModels[i]);
+                    if (lodSelection)
+                        ourModel.SelectLods(instanceModels[i], renderCamera.Position, projectionScale, lodThreshold);
+                    trianglesDrawn += ourModel.Draw(ourShader).triangles;
+                }
+            meshesDrawn = (unsigned int)ourModel.meshes.size();
+        }
+        unsigned long long allocationsThisFrame = drawAllocations.count();
 
         //i)
+        if (currentFrame - lastReport >= 1.0)
+        {
+            const ShaderStats &stats = Shader::frameStats();
+            std::cout << "uniform lookups avoided this frame: " << stats.lookupsAvoided() << " (by name: " << stats.nameWrites << ", location queries: " << stats.locationQueries << ")" << std::endl;
+            const UniformUploadStats &uploads = ourShader.uploadStats();
+            std::cout << "uniform uploads skipped this frame: " << stats.skippedUploads << " (program total: " << uploads.skippedCalls << " calls, " << uploads.skippedBytes << " bytes skipped, " << uploads.uploads << " uploaded)" << std::endl;
+            std::cout << "GL state calls this frame: " << GLStateCache::frameStats().issued << " issued, " << GLStateCache::frameStats().elided << " elided" << std::endl;
+            const DrawBatchStats &batch = DrawBatch::shared().stats();
+            if (instanceCount)
+                std::cout << instanceCount << " instances, " << (instancedDraw ? "one instanced draw per mesh and level" : "one Model::Draw per instance") << ", " << trianglesDrawn << " triangles of " << (size_t)instanceCount * (indexCount / 3) << " at full detail" << std::endl;
+            std::cout << "heap allocations in the draw calls this frame: " << allocationsThisFrame << std::endl;
+            if (meshlets.meshlets)
+                std::cout << "meshlets drawn: " << meshlets.meshlets - meshlets.frustumCulled - meshlets.backfaceCulled << " of " << meshlets.meshlets << " (" << meshlets.frustumCulled << " outside the frustum, " << meshlets.backfaceCulled << " facing away), triangles " << meshlets.trianglesDrawn << " of " << meshlets.triangles << " in " << meshlets.ranges << " ranges, " << meshlets.calls << " draw calls; culled in " << meshlets.milliseconds << " ms on up to " << MeshletCuller::shared().threadCount() << " threads" << std::endl;
+            else
+                std::cout << "meshes drawn: " << meshesDrawn << " of " << ourModel.meshes.size() << " in " << batch.calls << " draw calls, " << batch.groups << " groups (" << (batch.indirect ? "multi-draw indirect" : "multi-draw base vertex") << ")" << std::endl;
+            lastReport = currentFrame;
+        }
+        frameConstants.endFrame();
         glfwSwapBuffers(window);   
+        framesDrawn++;
     }
+    // with --replay every run follows the same camera path, so this is comparable between runs
+    double loopSeconds = glfwGetTime() - loopStart;
+    std::cout << framesDrawn << " frames in " << loopSeconds << " s, " << loopSeconds * 1000.0 / (framesDrawn ? framesDrawn : 1) << " ms per frame" << (input.replaying() ? " (replay)" : "") << std::endl;
+    std::cout << simulation.stepCount() << " simulation steps at " << SIMULATION_HZ << " Hz";
+    if (simulation.droppedTime() > 0.0)
+        std::cout << ", " << simulation.droppedTime() << " s dropped after slow frames";
+    std::cout << std::endl;
+    if (input.dropped())
+        std::cout << "input events dropped: " << input.dropped() << std::endl;
+    // steady state: the model loaded and every frame's allocations made and freed
+    MemoryUsage memoryEnd = processMemoryUsage();
+    std::cout << "resident memory at exit: " << memoryEnd.residentBytes / 1024 << " KB, peak " << memoryEnd.peakBytes / 1024 << " KB" << std::endl;
 
     //29)
     glfwTerminate();
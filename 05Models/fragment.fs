@@ -5,8 +5,24 @@ in vec2 TexCoords;
 
 uniform sampler2D texture_diffuse1;
 
+#ifdef HAS_SPECULAR_MAP
+// built only for materials with a specular map (SHADER_SPECULAR_MAP): a highlight from a light at the camera,
+// as strong as the map says
+#include "frameconstants.glsl"
+
+in vec3 Normal;
+in vec3 FragPos;
+
+uniform sampler2D texture_specular1;
+#endif
+
 void main()
 {    
     FragColor = texture(texture_diffuse1, TexCoords);
+#ifdef HAS_SPECULAR_MAP
+    vec3 toCamera = normalize(cameraPos - FragPos);
+    float highlight = pow(max(dot(normalize(Normal), toCamera), 0.0), 32.0);
+    FragColor.rgb += texture(texture_specular1, TexCoords).rgb * highlight;
+#endif
 }
 
@@ -0,0 +1,63 @@
+// Generated by tools/shadergen.cpp from 05Models/vertex.vs and 05Models/fragment.fs; do not edit.
+// After changing the GLSL, rerun ./shadergen tools/shaderprograms.txt from the repository root.
+
+#ifndef MODEL_PROGRAM_H
+#define MODEL_PROGRAM_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <shaders.h>
+
+// typed interface of the Model program: the handles are resolved once per link, so nothing
+// in the draw path spells or hashes a uniform name
+class ModelProgram
+{
+public:
+    // vertex inputs, from their layout (location = N) qualifiers
+    static const GLuint aPosLocation = 0;
+    static const GLuint aNormalLocation = 1;
+    static const GLuint aTexCoordsLocation = 2;
+    static const GLuint aPositionOffsetLocation = 7;
+    static const GLuint aPositionScaleLocation = 8;
+    // bit N for every vertex attribute above (locations below 7, VertexAttribute in vertexformat.h); meshes
+    // built for this program can leave the other attributes out
+    static const unsigned int attributeMask = 0x7;
+    // texture unit of each sampler: material textures on their role's unit (textureroles.h), the others in
+    // declaration order after those; bind() points the samplers at them
+    static const GLuint texture_diffuse1Unit = 0;
+
+    Shader &shader;
+
+    explicit ModelProgram(Shader &shader) : shader(shader)
+    {
+        bind();
+    }
+
+    // activates the program, resolving the handles again first if it was rebuilt (see ShaderWatcher)
+    void use()
+    {
+        if (generation != shader.generation)
+            bind();
+        shader.use();
+    }
+    void setModel(const glm::mat4 &value) const
+    {
+        shader.setMat4(model, value);
+    }
+
+private:
+    unsigned int generation;
+    UniformHandle<glm::mat4> model;
+    UniformHandle<int> texture_diffuse1;
+
+    void bind()
+    {
+        generation = shader.generation;
+        model = shader.uniform<glm::mat4>("model");
+        texture_diffuse1 = shader.uniform<int>("texture_diffuse1");
+        shader.use();
+        shader.setInt(texture_diffuse1, texture_diffuse1Unit);
+    }
+};
+#endif
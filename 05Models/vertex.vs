@@ -5,12 +5,23 @@ layout (location = 2) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "instancing.glsl"
+#include "frameconstants.glsl"
+#include "vertexformat.glsl"
+
+#ifdef HAS_SPECULAR_MAP
+// only the specular variant lights the surface, so only it needs a normal and a world position
+out vec3 Normal;
+out vec3 FragPos;
+#endif
 
 void main()
 {
     TexCoords = aTexCoords;    
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vec4 worldPos = modelMatrix() * vec4(decodePosition(aPos), 1.0);
+#ifdef HAS_SPECULAR_MAP
+    FragPos = worldPos.xyz;
+    Normal = mat3(modelMatrix()) * decodeNormal(aNormal);
+#endif
+    gl_Position = viewProj * worldPos;
 }
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdio>
+
+#include "camera.h"
+#include "frustum.h"
+
+//No window needed: scatters boxes and spheres around a camera and measures how many objects each culling kernel tests per millisecond
+//Timings only mean something optimized: g++ -O2 -I Includes 06Culling/00cullbenchmark.cpp -o cullbench && ./cullbench
+
+//1)
+const unsigned int COUNTS[] = {10000, 100000, 1000000};
+const CullPath PATHS[] = {CULL_SCALAR, CULL_SSE, CULL_AVX};
+const char* const PATH_NAMES[] = {"scalar", "sse", "avx"};
+
+//2)
+template <typename Batch>
+double objectsPerMillisecond(const Frustum &frustum, const Batch &batch, std::vector<std::uint64_t> &visible, CullPath path, unsigned int &visibleCount)
+{
+    //a) repeat until at least ~50 ms were measured so the small batches aren't all timer noise
+    unsigned int runs = 0;
+    double elapsed = 0.0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (elapsed < 50.0)
+    {
+        visibleCount = frustum.cull(batch, visible, path);
+        runs++;
+        elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    return (double)batch.size() * runs / elapsed;
+}
+
+int main()
+{
+    //3) a camera at the origin looking down -z, objects spread in a cube around it so only a few percent are visible
+    Camera camera(glm::vec3(0.0f, 0.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f/600.0f, 0.1f, 100.0f);
+    Frustum frustum = camera.GetFrustum(projection);
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> size(0.1f, 2.0f);
+    printf("best path on this CPU: %s\n", PATH_NAMES[Frustum::bestPath()]);
+
+    for (unsigned int c = 0; c < sizeof(COUNTS)/sizeof(COUNTS[0]); c++)
+    {
+        //4)
+        AABBBatch boxes;
+        SphereBatch spheres;
+        boxes.reserve(COUNTS[c]);
+        spheres.reserve(COUNTS[c]);
+        for (unsigned int i = 0; i < COUNTS[c]; i++)
+        {
+            glm::vec3 center(position(random), position(random), position(random));
+            glm::vec3 extent(size(random), size(random), size(random));
+            boxes.add(center - extent, center + extent);
+            spheres.add(center, size(random));
+        }
+
+        //5) every path has to agree with the scalar reference bit for bit
+        std::vector<std::uint64_t> boxReference, sphereReference, visible;
+        unsigned int boxesVisible, spheresVisible;
+        frustum.cull(boxes, boxReference, CULL_SCALAR);
+        frustum.cull(spheres, sphereReference, CULL_SCALAR);
+        for (unsigned int p = 0; p < sizeof(PATHS)/sizeof(PATHS[0]); p++)
+        {
+            if (PATHS[p] == CULL_AVX && Frustum::bestPath() != CULL_AVX)
+                continue;
+            double boxRate = objectsPerMillisecond(frustum, boxes, visible, PATHS[p], boxesVisible);
+            bool boxesAgree = visible == boxReference;
+            double sphereRate = objectsPerMillisecond(frustum, spheres, visible, PATHS[p], spheresVisible);
+            bool spheresAgree = visible == sphereReference;
+            printf("%8u objects  %-6s  boxes %9.0f/ms (%u visible%s)  spheres %9.0f/ms (%u visible%s)\n",
+                COUNTS[c], PATH_NAMES[p], boxRate, boxesVisible, boxesAgree ? "" : ", MISMATCH", sphereRate, spheresVisible, spheresAgree ? "" : ", MISMATCH");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include <glm/glm.hpp>
+#include <random>
+#include <vector>
+#include <cstdio>
+
+#include "camera.h"
+#include "frustum.h"
+
+//No window needed: runs a render loop's worth of camera work for 1000 frames, with the camera idle except for one mouse move and one scroll,
+//and shows that the matrices, the frustum and the culling result downstream are only rebuilt on those frames
+
+//1)
+const unsigned int FRAMES = 1000;
+const unsigned int OBJECTS = 100000;
+
+int main()
+{
+    //2)
+    Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+    camera.SetPerspective(800.0f/600.0f, 0.1f, 100.0f);
+
+    //3)
+    AABBBatch boxes;
+    boxes.reserve(OBJECTS);
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+    for (unsigned int i = 0; i < OBJECTS; i++)
+    {
+        glm::vec3 center(position(random), position(random), position(random));
+        boxes.add(center - glm::vec3(1.0f), center + glm::vec3(1.0f));
+    }
+
+    //4) the culling result is a downstream cache: it stays valid as long as the camera version it was built for
+    std::vector<std::uint64_t> visible;
+    unsigned int visibleCount = 0;
+    unsigned int culledVersion = 0;
+    unsigned int cullRuns = 0;
+
+    for (unsigned int frame = 0; frame < FRAMES; frame++)
+    {
+        //a) input: nothing happens except on two frames
+        camera.ProcessKeyboard(FORWARD, 0.0f);
+        camera.ProcessMouseMovement(frame == 300 ? 15.0f : 0.0f, 0.0f);
+        camera.ProcessMouseScroll(frame == 600 ? 5.0f : 0.0f);
+
+        //b) everything a frame asks of the camera
+        camera.GetViewMatrix();
+        camera.GetProjectionMatrix();
+        camera.GetViewProjectionMatrix();
+
+        //c)
+        if (camera.Version() != culledVersion)
+        {
+            visibleCount = camera.GetFrustum().cull(boxes, visible);
+            culledVersion = camera.Version();
+            cullRuns++;
+        }
+    }
+
+    //5) expected: view and projection twice each (the first frame, then the one input that touches them),
+    //   view*projection, frustum and culling three times (the first frame, the mouse move, the scroll)
+    const CameraStats &stats = camera.Stats();
+    printf("%u frames, camera version %u\n", FRAMES, camera.Version());
+    printf("view matrix rebuilt:       %u\n", stats.viewUpdates);
+    printf("projection rebuilt:        %u\n", stats.projectionUpdates);
+    printf("view*projection rebuilt:   %u\n", stats.viewProjectionUpdates);
+    printf("frustum rebuilt:           %u\n", stats.frustumUpdates);
+    printf("culling runs:              %u (%u of %u boxes visible)\n", cullRuns, visibleCount, OBJECTS);
+    return 0;
+}
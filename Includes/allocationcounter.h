@@ -0,0 +1,97 @@
+/*
+Counts the heap allocations made through the global operator new, so a sample can show that a code path (the draw loop) allocates nothing. Replacing operator new is a whole-program choice: include this in exactly one translation unit
+*/
+
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// allocations since the program started
+inline std::atomic<unsigned long long> heapAllocations(0);
+
+// allocations made between construction and count(), e.g. around one frame's draw calls
+class AllocationScope
+{
+public:
+    AllocationScope() : start(heapAllocations.load(std::memory_order_relaxed))
+    {
+    }
+    unsigned long long count() const
+    {
+        return heapAllocations.load(std::memory_order_relaxed) - start;
+    }
+
+private:
+    unsigned long long start;
+};
+
+// GCC inlines these into their callers and, seeing free() on what operator new returned, warns about a
+// mismatched deallocation (-Wmismatched-new-delete): they do match, malloc and free underneath both
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new(std::size_t size)
+{
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+// over-aligned types (alignas beyond the default new alignment) come through here rather than the above;
+// aligned_alloc wants a size that is a multiple of the alignment
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    std::size_t align = (std::size_t)alignment;
+    if (void *p = std::aligned_alloc(align, ((size ? size : 1) + align - 1) / align * align))
+        return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+void operator delete[](void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+void operator delete(void *p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
@@ -0,0 +1,257 @@
+/*
+std140/std430 block layouts computed at compile time: a block is described as a list of glm field types, the offsets and padding rules of the GLSL spec are applied by the compiler, and values are packed straight into mapped buffer memory without a hand-padded mirror struct
+*/
+
+#ifndef BLOCK_LAYOUT_H
+#define BLOCK_LAYOUT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <shaders.h>
+
+#include <array>
+#include <tuple>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <iostream>
+
+enum class BlockLayout
+{
+    Std140, // uniform blocks; arrays and structs are padded to vec4 alignment
+    Std430  // storage blocks; arrays and structs keep their natural alignment
+};
+
+constexpr std::size_t blockRoundUp(std::size_t value, std::size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// base alignment and size of one field under a layout, and how to copy a value of it into the block;
+// there is no primary definition, so a field type the layout rules don't cover fails to compile
+template <BlockLayout Layout, typename T>
+struct FieldLayout;
+
+// float, int and uint
+template <BlockLayout Layout, typename T>
+struct ScalarLayout
+{
+    static_assert(sizeof(T) == 4, "block scalars must be 32 bits wide");
+    static constexpr std::size_t alignment = 4;
+    static constexpr std::size_t size = 4;
+    static void pack(unsigned char *destination, const T &value)
+    {
+        std::memcpy(destination, &value, size);
+    }
+};
+template <BlockLayout Layout> struct FieldLayout<Layout, float>        : ScalarLayout<Layout, float> {};
+template <BlockLayout Layout> struct FieldLayout<Layout, int>          : ScalarLayout<Layout, int> {};
+template <BlockLayout Layout> struct FieldLayout<Layout, unsigned int> : ScalarLayout<Layout, unsigned int> {};
+
+// vec2 aligns to 8, vec3 and vec4 to 16; a vec3 is still only 12 bytes, so a scalar can follow it directly
+template <BlockLayout Layout, glm::length_t N, typename T, glm::qualifier Q>
+struct FieldLayout<Layout, glm::vec<N, T, Q>>
+{
+    static_assert(sizeof(T) == 4, "block vectors must have 32 bit components");
+    static constexpr std::size_t alignment = N == 1 ? 4 : N == 2 ? 8 : 16;
+    static constexpr std::size_t size = 4 * N;
+    static void pack(unsigned char *destination, const glm::vec<N, T, Q> &value)
+    {
+        std::memcpy(destination, &value[0], size);
+    }
+};
+
+// a matrix is laid out as an array of its column vectors, so under std140 every column starts on 16 bytes
+// (a mat3 takes 48 bytes, not 36)
+template <BlockLayout Layout, glm::length_t C, glm::length_t R, typename T, glm::qualifier Q>
+struct FieldLayout<Layout, glm::mat<C, R, T, Q>>
+{
+    typedef FieldLayout<Layout, glm::vec<R, T, Q>> Column;
+    static constexpr std::size_t alignment = Layout == BlockLayout::Std140 ? blockRoundUp(Column::alignment, 16) : Column::alignment;
+    static constexpr std::size_t stride = blockRoundUp(Column::size, alignment);
+    static constexpr std::size_t size = stride * C;
+    static void pack(unsigned char *destination, const glm::mat<C, R, T, Q> &value)
+    {
+        for (glm::length_t column = 0; column < C; column++)
+            Column::pack(destination + column * stride, value[column]);
+    }
+};
+
+// arrays: std140 rounds the element stride up to a vec4, std430 only to the element's own alignment
+template <BlockLayout Layout, typename T, std::size_t N>
+struct FieldLayout<Layout, T[N]>
+{
+    typedef FieldLayout<Layout, T> Element;
+    static constexpr std::size_t alignment = Layout == BlockLayout::Std140 ? blockRoundUp(Element::alignment, 16) : Element::alignment;
+    static constexpr std::size_t stride = blockRoundUp(Element::size, alignment);
+    static constexpr std::size_t size = stride * N;
+    static void pack(unsigned char *destination, const T (&value)[N])
+    {
+        for (std::size_t i = 0; i < N; i++)
+            Element::pack(destination + i * stride, value[i]);
+    }
+};
+
+// each field starts at the next multiple of its base alignment after the end of the previous one; the last
+// entry is where the last field ends
+template <std::size_t N>
+constexpr std::array<std::size_t, N + 1> blockOffsets(const std::array<std::size_t, N> &alignments, const std::array<std::size_t, N> &sizes)
+{
+    std::array<std::size_t, N + 1> result = {};
+    std::size_t at = 0;
+    for (std::size_t i = 0; i < N; i++)
+    {
+        at = blockRoundUp(at, alignments[i]);
+        result[i] = at;
+        at += sizes[i];
+    }
+    result[N] = at;
+    return result;
+}
+template <std::size_t N>
+constexpr std::size_t blockMaxAlignment(const std::array<std::size_t, N> &alignments)
+{
+    std::size_t result = 0;
+    for (std::size_t i = 0; i < N; i++)
+        result = alignments[i] > result ? alignments[i] : result;
+    return result;
+}
+
+// A block (or a struct inside one) as an ordered list of field types; the offsets are constants, so packing a
+// field compiles down to a store at a fixed address. Field i is addressed by index, typically through an enum
+// whose order matches the GLSL declaration:
+//
+//     typedef Std140Struct<glm::mat4, glm::vec3, float> Lights;   // mat4 at 0, vec3 at 64, float at 76
+//     Lights::pack<1>(mapped, position);
+//
+// A nested BlockStruct is a valid field type; write its members with the nested type's pack on field<I>().
+template <BlockLayout Layout, typename... Fields>
+struct BlockStruct
+{
+    static_assert(sizeof...(Fields) > 0, "a block needs at least one field");
+    static constexpr std::size_t count = sizeof...(Fields);
+
+    template <std::size_t I>
+    using FieldType = typename std::tuple_element<I, std::tuple<Fields...>>::type;
+
+private:
+    static constexpr std::array<std::size_t, count> fieldAlignments = {{ FieldLayout<Layout, Fields>::alignment... }};
+    static constexpr std::array<std::size_t, count> fieldSizes = {{ FieldLayout<Layout, Fields>::size... }};
+    static constexpr std::array<std::size_t, count + 1> offsets = blockOffsets(fieldAlignments, fieldSizes);
+
+public:
+    // as a member of another block: std140 rounds a struct's alignment up to a vec4
+    static constexpr std::size_t alignment = Layout == BlockLayout::Std140 ? blockRoundUp(blockMaxAlignment(fieldAlignments), 16) : blockMaxAlignment(fieldAlignments);
+    // bytes up to the end of the last field, and the padded size used when the struct is nested or arrayed
+    static constexpr std::size_t used = offsets[count];
+    static constexpr std::size_t size = blockRoundUp(used, alignment);
+
+    static constexpr std::size_t offset(std::size_t field)
+    {
+        return offsets[field];
+    }
+
+    // address of field I inside a block starting at destination (e.g. the pointer glMapBufferRange returned)
+    template <std::size_t I>
+    static unsigned char* field(void *destination)
+    {
+        return (unsigned char*)destination + offsets[I];
+    }
+    // writes one field; the padding around it is left untouched
+    template <std::size_t I>
+    static void pack(void *destination, const FieldType<I> &value)
+    {
+        FieldLayout<Layout, FieldType<I>>::pack(field<I>(destination), value);
+    }
+    // writes every field, in declaration order
+    static void pack(void *destination, const Fields&... values)
+    {
+        packAll(destination, std::index_sequence_for<Fields...>(), values...);
+    }
+
+    // checks the computed offsets against what the driver reflects for the linked program; members the compiler
+    // optimized out are skipped. memberNames lists the GLSL names in field order (with the instance name
+    // prefix, "Block.member", when the block declares one).
+    static bool matches(const Shader &shader, const char *blockName, const char* const (&memberNames)[count])
+    {
+        bool ok = true;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            GLint reflected = reflectedOffset(shader.ID, memberNames[i]);
+            if (reflected >= 0 && (std::size_t)reflected != offsets[i])
+            {
+                std::cout << "ERROR::BLOCK_LAYOUT::OFFSET_MISMATCH: " << blockName << "." << memberNames[i] << " is at " << reflected << " in the program, " << offsets[i] << " in C++" << std::endl;
+                ok = false;
+            }
+        }
+        GLint reflectedSize = reflectedBlockSize(shader.ID, blockName);
+        if (reflectedSize >= 0 && (std::size_t)reflectedSize < used)
+        {
+            std::cout << "ERROR::BLOCK_LAYOUT::SIZE_MISMATCH: " << blockName << " is " << reflectedSize << " bytes in the program, " << used << " in C++" << std::endl;
+            ok = false;
+        }
+        return ok;
+    }
+
+private:
+    template <std::size_t... I>
+    static void packAll(void *destination, std::index_sequence<I...>, const Fields&... values)
+    {
+        (pack<I>(destination, values), ...);
+    }
+
+    // uniform blocks are reflected through the 3.1 uniform queries; storage blocks need the 4.3 program
+    // interface queries, which glad leaves null on older contexts (then nothing is checked)
+    static GLint reflectedOffset(GLuint program, const char *name)
+    {
+        GLint offset = -1;
+        if (Layout == BlockLayout::Std140)
+        {
+            GLuint index = GL_INVALID_INDEX;
+            glGetUniformIndices(program, 1, &name, &index);
+            if (index != GL_INVALID_INDEX)
+                glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_OFFSET, &offset);
+        }
+        else if (glGetProgramResourceIndex && glGetProgramResourceiv)
+        {
+            GLuint index = glGetProgramResourceIndex(program, GL_BUFFER_VARIABLE, name);
+            GLenum property = GL_OFFSET;
+            if (index != GL_INVALID_INDEX)
+                glGetProgramResourceiv(program, GL_BUFFER_VARIABLE, index, 1, &property, 1, NULL, &offset);
+        }
+        return offset;
+    }
+    static GLint reflectedBlockSize(GLuint program, const char *name)
+    {
+        GLint size = -1;
+        if (Layout == BlockLayout::Std140)
+        {
+            GLuint index = glGetUniformBlockIndex(program, name);
+            if (index != GL_INVALID_INDEX)
+                glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+        }
+        else if (glGetProgramResourceIndex && glGetProgramResourceiv)
+        {
+            GLuint index = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, name);
+            GLenum property = GL_BUFFER_DATA_SIZE;
+            if (index != GL_INVALID_INDEX)
+                glGetProgramResourceiv(program, GL_SHADER_STORAGE_BLOCK, index, 1, &property, 1, NULL, &size);
+        }
+        return size;
+    }
+};
+
+template <typename... Fields>
+using Std140Struct = BlockStruct<BlockLayout::Std140, Fields...>;
+template <typename... Fields>
+using Std430Struct = BlockStruct<BlockLayout::Std430, Fields...>;
+
+// nested structs, as fields of an enclosing block of the same layout
+template <BlockLayout Layout, typename... Fields>
+struct FieldLayout<Layout, BlockStruct<Layout, Fields...>>
+{
+    static constexpr std::size_t alignment = BlockStruct<Layout, Fields...>::alignment;
+    static constexpr std::size_t size = BlockStruct<Layout, Fields...>::size;
+};
+#endif
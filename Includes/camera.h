@@ -5,6 +5,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <frustum.h>
+
 #include <vector>
 
 // Defines several possible options for camera movement. Used as abstraction to stay away from window-system specific input methods
@@ -21,9 +23,25 @@ const float PITCH       =  0.0f;
 const float SPEED       =  2.5f;
 const float SENSITIVITY =  0.1f;
 const float ZOOM        =  45.0f;
+const float ASPECT      =  800.0f / 600.0f;
+const float NEAR_PLANE  =  0.1f;
+const float FAR_PLANE   =  100.0f;
+
+// how often the cached matrices were actually rebuilt; an idle camera keeps these still
+struct CameraStats
+{
+    unsigned int viewUpdates = 0;
+    unsigned int projectionUpdates = 0;
+    unsigned int viewProjectionUpdates = 0;
+    unsigned int frustumUpdates = 0;
+};
 
 
-// An abstract camera class that processes input and calculates the corresponding Euler Angles, Vectors and Matrices for use in OpenGL
+// An abstract camera class that processes input and calculates the corresponding Euler Angles, Vectors and Matrices for use in OpenGL.
+// The matrices are cached and only rebuilt after something they depend on changed; Version() goes up with every
+// change, so anything derived from the camera (culling results, uploads, sorted draw lists) can be kept as long
+// as the version it was built for is still current. Code that writes the public attributes directly must call
+// Invalidate() afterwards.
 class Camera
 {
 public:
@@ -42,7 +60,7 @@ public:
     float Zoom;
 
     // constructor with vectors
-    Camera(glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f), float yaw = YAW, float pitch = PITCH) : Front(glm::vec3(0.0f, 0.0f, -1.0f)), MovementSpeed(SPEED), MouseSensitivity(SENSITIVITY), Zoom(ZOOM)
+    Camera(glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f), float yaw = YAW, float pitch = PITCH) : Front(glm::vec3(0.0f, 0.0f, -1.0f)), MovementSpeed(SPEED), MouseSensitivity(SENSITIVITY), Zoom(ZOOM), aspect(ASPECT), nearPlane(NEAR_PLANE), farPlane(FAR_PLANE), dirty(ALL_DIRTY), version(1)
     {
         Position = position;
         WorldUp = up;
@@ -51,7 +69,7 @@ public:
         updateCameraVectors();
     }
     // constructor with scalar values
-    Camera(float posX, float posY, float posZ, float upX, float upY, float upZ, float yaw, float pitch) : Front(glm::vec3(0.0f, 0.0f, -1.0f)), MovementSpeed(SPEED), MouseSensitivity(SENSITIVITY), Zoom(ZOOM)
+    Camera(float posX, float posY, float posZ, float upX, float upY, float upZ, float yaw, float pitch) : Front(glm::vec3(0.0f, 0.0f, -1.0f)), MovementSpeed(SPEED), MouseSensitivity(SENSITIVITY), Zoom(ZOOM), aspect(ASPECT), nearPlane(NEAR_PLANE), farPlane(FAR_PLANE), dirty(ALL_DIRTY), version(1)
     {
         Position = glm::vec3(posX, posY, posZ);
         WorldUp = glm::vec3(upX, upY, upZ);
@@ -61,15 +79,116 @@ public:
     }
 
     // returns the view matrix calculated using Euler Angles and the LookAt Matrix
-    glm::mat4 GetViewMatrix()
+    const glm::mat4& GetViewMatrix()
+    {
+        if (dirty & VIEW_DIRTY)
+        {
+            view = glm::lookAt(Position, Position + Front, Up);
+            dirty &= ~VIEW_DIRTY;
+            stats.viewUpdates++;
+        }
+        return view;
+    }
+
+    // returns the perspective projection for Zoom and the settings from SetPerspective
+    const glm::mat4& GetProjectionMatrix()
+    {
+        if (dirty & PROJECTION_DIRTY)
+        {
+            projection = glm::perspective(glm::radians(Zoom), aspect, nearPlane, farPlane);
+            dirty &= ~PROJECTION_DIRTY;
+            stats.projectionUpdates++;
+        }
+        return projection;
+    }
+
+    // returns projection * view
+    const glm::mat4& GetViewProjectionMatrix()
+    {
+        if (dirty & VIEW_PROJECTION_DIRTY)
+        {
+            viewProjection = GetProjectionMatrix() * GetViewMatrix();
+            dirty &= ~VIEW_PROJECTION_DIRTY;
+            stats.viewProjectionUpdates++;
+        }
+        return viewProjection;
+    }
+
+    // returns the world-space view frustum, for culling against
+    const Frustum& GetFrustum()
+    {
+        if (dirty & FRUSTUM_DIRTY)
+        {
+            frustum = Frustum(GetViewProjectionMatrix());
+            dirty &= ~FRUSTUM_DIRTY;
+            stats.frustumUpdates++;
+        }
+        return frustum;
+    }
+    // same for some other projection (not cached)
+    Frustum GetFrustum(const glm::mat4 &projection)
+    {
+        return Frustum(projection * GetViewMatrix());
+    }
+
+    // the projection settings besides the field of view, which is Zoom
+    void SetPerspective(float aspectRatio, float nearDistance, float farDistance)
+    {
+        if (aspectRatio == aspect && nearDistance == nearPlane && farDistance == farPlane)
+            return;
+        aspect = aspectRatio;
+        nearPlane = nearDistance;
+        farPlane = farDistance;
+        touch(PROJECTION_DIRTY);
+    }
+
+    // goes up whenever the view or the projection changes; never 0, so 0 can stand for "nothing cached yet"
+    unsigned int Version() const
+    {
+        return version;
+    }
+
+    // call after writing Position, Yaw, Pitch, WorldUp or Zoom directly
+    void Invalidate()
+    {
+        updateCameraVectors();
+        touch(ALL_DIRTY);
+    }
+
+    const CameraStats& Stats() const
     {
-        return glm::lookAt(Position, Position + Front, Up);
+        return stats;
+    }
+
+    // places this camera between two simulated states of another one (alpha 0 is from, 1 is to), for drawing
+    // frames that fall between fixed simulation steps; nothing is invalidated when the pose doesn't move
+    void Interpolate(const Camera &from, const Camera &to, float alpha)
+    {
+        glm::vec3 position = glm::mix(from.Position, to.Position, alpha);
+        float yaw = glm::mix(from.Yaw, to.Yaw, alpha);
+        float pitch = glm::mix(from.Pitch, to.Pitch, alpha);
+        float zoom = glm::mix(from.Zoom, to.Zoom, alpha);
+        unsigned int flags = 0;
+        if (position != Position || yaw != Yaw || pitch != Pitch)
+            flags |= VIEW_DIRTY;
+        if (zoom != Zoom)
+            flags |= PROJECTION_DIRTY;
+        if (!flags)
+            return;
+        Position = position;
+        Yaw = yaw;
+        Pitch = pitch;
+        Zoom = zoom;
+        updateCameraVectors();
+        touch(flags);
     }
 
     // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, float deltaTime)
     {
         float velocity = MovementSpeed * deltaTime;
+        if (velocity == 0.0f)
+            return;
         if (direction == FORWARD)
             Position += Front * velocity;
         if (direction == BACKWARD)
@@ -78,11 +197,14 @@ public:
             Position -= Right * velocity;
         if (direction == RIGHT)
             Position += Right * velocity;
+        touch(VIEW_DIRTY);
     }
 
     // processes input received from a mouse input system. Expects the offset value in both the x and y direction.
     void ProcessMouseMovement(float xoffset, float yoffset, GLboolean constrainPitch = true)
     {
+        if (xoffset == 0.0f && yoffset == 0.0f)
+            return;
         xoffset *= MouseSensitivity;
         yoffset *= MouseSensitivity;
 
@@ -100,19 +222,51 @@ public:
 
         // update Front, Right and Up Vectors using the updated Euler angles
         updateCameraVectors();
+        touch(VIEW_DIRTY);
     }
 
     // processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
     void ProcessMouseScroll(float yoffset)
     {
+        float previous = Zoom;
         Zoom -= (float)yoffset;
         if (Zoom < 1.0f)
             Zoom = 1.0f;
         if (Zoom > 45.0f)
             Zoom = 45.0f; 
+        if (Zoom != previous)
+            touch(PROJECTION_DIRTY);
     }
 
 private:
+    // what each cached value needs before it can be handed out again
+    enum
+    {
+        VIEW_DIRTY            = 1 << 0,
+        PROJECTION_DIRTY      = 1 << 1,
+        VIEW_PROJECTION_DIRTY = 1 << 2,
+        FRUSTUM_DIRTY         = 1 << 3,
+        ALL_DIRTY             = VIEW_DIRTY | PROJECTION_DIRTY | VIEW_PROJECTION_DIRTY | FRUSTUM_DIRTY
+    };
+    float aspect;
+    float nearPlane;
+    float farPlane;
+    unsigned int dirty;
+    unsigned int version;
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    Frustum frustum;
+    CameraStats stats;
+
+    // the derived values depend on both matrices, so they go stale with either
+    void touch(unsigned int flags)
+    {
+        dirty |= flags | VIEW_PROJECTION_DIRTY | FRUSTUM_DIRTY;
+        if (++version == 0)
+            version = 1;
+    }
+
     // calculates the front vector from the Camera's (updated) Euler Angles
     void updateCameraVectors()
     {
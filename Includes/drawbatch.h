@@ -0,0 +1,223 @@
+/*
+Submission of many meshes in a handful of API calls: meshes that share a VAO, an index type and their textures form a group, and each group goes out as one glMultiDrawElementsIndirect over commands written to an indirect buffer, with the per-draw inputs fetched through the base instance. Without GL 4.3 a group goes out as glMultiDrawElementsBaseVertex calls instead
+*/
+
+#ifndef DRAW_BATCH_H
+#define DRAW_BATCH_H
+
+#include <glad/glad.h>
+
+#include <mesh.h>
+#include <shaders.h>
+#include <glstate.h>
+#include <geometryarena.h>
+
+#include <vector>
+
+// one command of glMultiDrawElementsIndirect, laid out the way GL reads it from the indirect buffer
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;   // in indices, not bytes
+    GLint  baseVertex;
+    GLuint baseInstance; // the range id, where the draw's per-draw inputs sit in the arena's draw data
+};
+
+struct DrawBatchStats
+{
+    unsigned int draws = 0;  // meshes submitted
+    unsigned int groups = 0;
+    unsigned int calls = 0;  // draw calls that reached the driver
+    unsigned int triangles = 0;
+    bool indirect = false;   // whether they were indirect multi-draws
+};
+
+class DrawBatch
+{
+public:
+    // turn off to use the glMultiDrawElementsBaseVertex path even where multi-draw indirect is available
+    bool allowIndirect = true;
+
+    DrawBatch() = default;
+    DrawBatch(const DrawBatch&) = delete;
+    DrawBatch& operator=(const DrawBatch&) = delete;
+
+    // the batch Model draws through unless it is given another one
+    static DrawBatch& shared()
+    {
+        static DrawBatch batch;
+        return batch;
+    }
+
+    // glMultiDrawElementsIndirect is core since 4.3, and it needs the base instance of its commands (4.2)
+    static bool supportsIndirect()
+    {
+        return GLAD_GL_VERSION_4_3 && glMultiDrawElementsIndirect != NULL;
+    }
+
+    // empties the batch; the groups' storage is kept for the next frame
+    void clear()
+    {
+        for (unsigned int i = 0; i < groupCount; i++)
+            groups[i].commands.clear();
+        groupCount = 0;
+    }
+
+    // queues a mesh, at its current level of detail, into the group of its state. The mesh's range is read now, so anything that moves ranges
+    // (GeometryArena::defragment) has to happen before the meshes are added
+    void add(Mesh &mesh)
+    {
+        Group *group = NULL;
+        for (unsigned int i = 0; i < groupCount && !group; i++)
+            if (sameState(*groups[i].material, mesh))
+                group = &groups[i];
+        if (!group)
+        {
+            if (groupCount == groups.size())
+                groups.push_back(Group());
+            group = &groups[groupCount++];
+            group->material = &mesh;
+        }
+        const GeometryRange &range = mesh.currentGeometry();
+        DrawElementsIndirectCommand command;
+        command.count = (GLuint)mesh.lodIndexCount();
+        command.instanceCount = 1;
+        // index offsets are 4-aligned, so they divide evenly by any index size
+        command.firstIndex = (GLuint)(range.indexOffset / indexSize(mesh.indexType)) + mesh.lods[mesh.lod].firstIndex;
+        command.baseVertex = range.baseVertex;
+        command.baseInstance = range.id;
+        group->commands.push_back(command);
+    }
+
+    // draws everything queued, binding each group's textures once
+    const DrawBatchStats& submit(Shader &shader)
+    {
+        return submitGroups(shader, false);
+    }
+    // positions only, for depth and shadow passes
+    const DrawBatchStats& submitDepth(Shader &shader)
+    {
+        return submitGroups(shader, true);
+    }
+
+    // what the last submit did
+    const DrawBatchStats& stats() const
+    {
+        return lastStats;
+    }
+
+private:
+    struct Group
+    {
+        Mesh *material = NULL; // the first mesh added: its pool, index type and textures stand for the group
+        std::vector<DrawElementsIndirectCommand> commands;
+    };
+    std::vector<Group> groups;
+    unsigned int groupCount = 0;
+    DrawBatchStats lastStats;
+    GLuint indirectBuffer = 0;
+    // scratch space, kept to avoid allocating every frame
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    std::vector<GLint> baseVertices;
+
+    static bool sameState(Mesh &a, Mesh &b)
+    {
+        if (a.arena != b.arena || a.currentGeometry().pool != b.currentGeometry().pool || a.indexType != b.indexType || a.textures.size() != b.textures.size())
+            return false;
+        for (unsigned int i = 0; i < a.textures.size(); i++)
+            if (a.textures[i].id != b.textures[i].id)
+                return false;
+        return true;
+    }
+
+    const DrawBatchStats& submitGroups(Shader &shader, bool depth)
+    {
+        lastStats = DrawBatchStats();
+        lastStats.groups = groupCount;
+        lastStats.indirect = allowIndirect && supportsIndirect();
+        for (unsigned int i = 0; i < groupCount; i++)
+        {
+            lastStats.draws += (unsigned int)groups[i].commands.size();
+            for (unsigned int c = 0; c < groups[i].commands.size(); c++)
+                lastStats.triangles += groups[i].commands[c].count / 3;
+        }
+        if (lastStats.draws == 0)
+            return lastStats;
+
+        if (lastStats.indirect)
+        {
+            // every group's commands back to back, in one upload
+            commands.clear();
+            for (unsigned int i = 0; i < groupCount; i++)
+                commands.insert(commands.end(), groups[i].commands.begin(), groups[i].commands.end());
+            if (!indirectBuffer)
+                glGenBuffers(1, &indirectBuffer);
+            GLStateCache::bindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            // a new store every time, so the upload never waits for the previous frame's draws to be done with it
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+        }
+
+        size_t first = 0;
+        for (unsigned int i = 0; i < groupCount; i++)
+        {
+            Group &group = groups[i];
+            Mesh &material = *group.material;
+            const GeometryRange &range = material.currentGeometry();
+            if (!depth)
+                material.BindMaterial(shader);
+            if (lastStats.indirect)
+            {
+                if (depth)
+                    material.arena->bindMultiDrawDepth(range);
+                else
+                    material.arena->bindMultiDraw(range);
+                glMultiDrawElementsIndirect(GL_TRIANGLES, material.indexType, (void*)(first * sizeof(DrawElementsIndirectCommand)), (GLsizei)group.commands.size(), 0);
+                lastStats.calls++;
+                first += group.commands.size();
+            }
+            else
+            {
+                if (depth)
+                    material.arena->bindDepth(range);
+                else
+                    material.arena->bind(range);
+                submitRuns(*material.arena, material.indexType, group.commands);
+            }
+        }
+        return lastStats;
+    }
+
+    // without base instances all draws of a call read the same constant per-draw inputs, so a group goes out in runs
+    // of draws whose inputs match: one call for meshes of the float format, about one per mesh for the packed ones
+    void submitRuns(const GeometryArena &arena, GLenum indexType, const std::vector<DrawElementsIndirectCommand> &group)
+    {
+        unsigned int size = indexSize(indexType);
+        size_t begin = 0;
+        while (begin < group.size())
+        {
+            const GeometryDrawData &data = arena.data(group[begin].baseInstance);
+            counts.clear();
+            offsets.clear();
+            baseVertices.clear();
+            size_t end = begin;
+            for (; end < group.size(); end++)
+            {
+                const GeometryDrawData &other = arena.data(group[end].baseInstance);
+                if (other.positionOffset != data.positionOffset || other.positionScale != data.positionScale)
+                    break;
+                counts.push_back((GLsizei)group[end].count);
+                offsets.push_back((const void*)((size_t)group[end].firstIndex * size));
+                baseVertices.push_back(group[end].baseVertex);
+            }
+            GLStateCache::vertexAttrib(DRAW_POSITION_OFFSET_LOCATION, data.positionOffset.x, data.positionOffset.y, data.positionOffset.z);
+            GLStateCache::vertexAttrib(DRAW_POSITION_SCALE_LOCATION, data.positionScale.x, data.positionScale.y, data.positionScale.z);
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), indexType, offsets.data(), (GLsizei)counts.size(), baseVertices.data());
+            lastStats.calls++;
+            begin = end;
+        }
+    }
+};
+#endif
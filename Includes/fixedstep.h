@@ -0,0 +1,107 @@
+/*
+A fixed-timestep clock: the simulation advances in steps of exactly 1/hz seconds however fast or unevenly frames are rendered, and the renderer draws the state interpolated between the last two steps
+*/
+
+#ifndef FIXED_STEP_H
+#define FIXED_STEP_H
+
+#include <glm/glm.hpp>
+
+// default simulation rate, and how many steps one frame may run before time is dropped instead (after a hitch,
+// catching up all at once would make the next frame slower still)
+const double SIMULATION_HZ = 60.0;
+const unsigned int MAX_STEPS_PER_FRAME = 8;
+
+class FixedStepClock
+{
+public:
+    FixedStepClock(double hz = SIMULATION_HZ, unsigned int maxStepsPerFrame = MAX_STEPS_PER_FRAME)
+        : dt(1.0 / hz), maxSteps(maxStepsPerFrame), started(false), last(0.0), accumulator(0.0), steps(0), dropped(0.0)
+    {
+    }
+
+    // takes the current time in seconds (keep it double: a float clock loses precision within hours) and
+    // returns how many steps to simulate before this frame is drawn
+    unsigned int advance(double now)
+    {
+        if (!started)
+        {
+            started = true;
+            last = now;
+            return 0;
+        }
+        accumulator += now - last;
+        last = now;
+        unsigned int count = (unsigned int)(accumulator / dt);
+        if (count > maxSteps)
+        {
+            double excess = (count - maxSteps) * dt;
+            dropped += excess;
+            accumulator -= excess;
+            count = maxSteps;
+        }
+        accumulator -= count * dt;
+        steps += count;
+        return count;
+    }
+
+    // length of one step in seconds
+    double step() const
+    {
+        return dt;
+    }
+    // where the frame falls between the previous step and the latest one, in [0, 1)
+    double alpha() const
+    {
+        return accumulator / dt;
+    }
+    // simulated time at the latest step; a multiple of the step, so it never drifts
+    double time() const
+    {
+        return steps * dt;
+    }
+    // simulated time at the interpolated state the frame shows (0 until the first step)
+    double renderTime() const
+    {
+        return steps ? time() - dt + accumulator : 0.0;
+    }
+    unsigned long long stepCount() const
+    {
+        return steps;
+    }
+    // seconds of wall time skipped because frames took too long to catch up with
+    double droppedTime() const
+    {
+        return dropped;
+    }
+
+private:
+    double dt;
+    unsigned int maxSteps;
+    bool started;
+    double last;
+    double accumulator;
+    unsigned long long steps;
+    double dropped;
+};
+
+// a value that changes once per step and is read between steps: call push() before each step changes current
+template <typename T>
+struct Interpolated
+{
+    T previous;
+    T current;
+
+    Interpolated(const T &value = T()) : previous(value), current(value)
+    {
+    }
+    void push()
+    {
+        previous = current;
+    }
+    T at(double alpha) const
+    {
+        return glm::mix(previous, current, (float)alpha);
+    }
+};
+#endif
@@ -0,0 +1,9 @@
+// per-frame camera data, filled once a frame by FrameConstantsBuffer; the FrameConstants layout in frameconstants.h lists the same fields in the same order
+layout (std140) uniform FrameConstants
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    vec3 cameraPos;
+    float time;
+};
@@ -0,0 +1,101 @@
+/*
+Per-frame camera data shared by every shader program through one std140 uniform block, written once a frame instead of pushing view and projection into each program separately
+*/
+
+#ifndef FRAME_CONSTANTS_H
+#define FRAME_CONSTANTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <shaders.h>
+#include <blocklayout.h>
+#include <glstate.h>
+#include <camera.h>
+
+// number of slices in the ring; a slice is only rewritten once the GPU has finished the frame that read it
+const unsigned int FRAME_CONSTANTS_RING = 3;
+
+// the block in frameconstants.glsl, field for field; the padding comes from the layout rules rather than by hand
+typedef Std140Struct<glm::mat4, glm::mat4, glm::mat4, glm::vec3, float> FrameConstants;
+enum FrameConstantsField
+{
+    FRAME_VIEW,
+    FRAME_PROJECTION,
+    FRAME_VIEW_PROJ,
+    FRAME_CAMERA_POS,
+    FRAME_TIME
+};
+const char* const FRAME_CONSTANTS_MEMBERS[FrameConstants::count] = { "view", "projection", "viewProj", "cameraPos", "time" };
+// the float packs into the vec3's last lane
+static_assert(FrameConstants::offset(FRAME_CAMERA_POS) == 192 && FrameConstants::offset(FRAME_TIME) == 204, "FrameConstants offsets drifted from the std140 rules");
+static_assert(FrameConstants::size == 208, "FrameConstants must match the std140 size of the GLSL block");
+
+class FrameConstantsBuffer
+{
+public:
+    unsigned int UBO;
+
+    // constructor, allocates the whole ring up front
+    FrameConstantsBuffer() : slot(0)
+    {
+        // every slice has to start on the uniform buffer offset alignment to be bindable with glBindBufferRange
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        stride = (FrameConstants::size + alignment - 1) / alignment * alignment;
+
+        glGenBuffers(1, &UBO);
+        GLStateCache::bindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, stride * FRAME_CONSTANTS_RING, NULL, GL_DYNAMIC_DRAW);
+        for (unsigned int i = 0; i < FRAME_CONSTANTS_RING; i++)
+            fences[i] = 0;
+    }
+    FrameConstantsBuffer(const FrameConstantsBuffer&) = delete;
+    FrameConstantsBuffer& operator=(const FrameConstantsBuffer&) = delete;
+
+    // fills the next slice from the camera's cached matrices and binds it for every program that declares the block
+    void write(Camera &camera, float time)
+    {
+        slot = (slot + 1) % FRAME_CONSTANTS_RING;
+        // once the fence says the slice is free the driver doesn't have to synchronize the mapping
+        GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+        // wait for the GPU to be done with the frame that last used this slice (normally it already has)
+        if (fences[slot])
+        {
+            GLenum status = glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            // after a timeout or a failed wait the GPU may still be reading the slice: leave it to the driver
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                access &= ~GL_MAP_UNSYNCHRONIZED_BIT;
+            glDeleteSync(fences[slot]);
+            fences[slot] = 0;
+        }
+        GLintptr offset = (GLintptr)(slot * stride);
+        GLStateCache::bindBuffer(GL_UNIFORM_BUFFER, UBO);
+        void *data = glMapBufferRange(GL_UNIFORM_BUFFER, offset, FrameConstants::size, access);
+        if (data)
+        {
+            // straight into the mapped slice, no staging copy
+            FrameConstants::pack(data, camera.GetViewMatrix(), camera.GetProjectionMatrix(), camera.GetViewProjectionMatrix(), camera.Position, time);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+        }
+        GLStateCache::bindBufferRange(GL_UNIFORM_BUFFER, FRAME_CONSTANTS_BINDING, UBO, offset, FrameConstants::size);
+    }
+
+    // whether the program's FrameConstants block has the offsets this buffer writes (true if it has no such block)
+    static bool matches(const Shader &shader)
+    {
+        return FrameConstants::matches(shader, FRAME_CONSTANTS_BLOCK, FRAME_CONSTANTS_MEMBERS);
+    }
+
+    // marks the end of the frame's draws so the slice can be recycled safely
+    void endFrame()
+    {
+        fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+private:
+    unsigned int stride;
+    unsigned int slot;
+    GLsync fences[FRAME_CONSTANTS_RING];
+};
+#endif
@@ -0,0 +1,269 @@
+/*
+View frustum planes and batch culling: bounding boxes and spheres are kept in structure-of-arrays batches and tested 4 (SSE) or 8 (AVX) at a time against the six planes, producing one visibility bit per object
+*/
+
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <bitset>
+#include <cstdint>
+#include <cmath>
+
+// the SIMD paths are x86 only; GLM's own SIMD support (glm/simd) is per-vec4 and only on with GLM_FORCE_INTRINSICS,
+// so the kernels use the intrinsics directly. AVX is compiled in through a target attribute and picked at run time,
+// so it is used even when the rest of the program is built without -mavx
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FRUSTUM_SIMD 1
+#include <immintrin.h>
+#endif
+
+// which kernel cull() runs; CULL_BEST picks the widest the CPU supports
+enum CullPath
+{
+    CULL_SCALAR,
+    CULL_SSE,
+    CULL_AVX,
+    CULL_BEST
+};
+
+// axis-aligned boxes as center and half extent, one array per component
+struct AABBBatch
+{
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+
+    unsigned int size() const
+    {
+        return (unsigned int)centerX.size();
+    }
+    void clear()
+    {
+        centerX.clear(); centerY.clear(); centerZ.clear();
+        extentX.clear(); extentY.clear(); extentZ.clear();
+    }
+    void reserve(unsigned int count)
+    {
+        centerX.reserve(count); centerY.reserve(count); centerZ.reserve(count);
+        extentX.reserve(count); extentY.reserve(count); extentZ.reserve(count);
+    }
+    void add(const glm::vec3 &min, const glm::vec3 &max)
+    {
+        glm::vec3 center = (min + max) * 0.5f;
+        glm::vec3 extent = (max - min) * 0.5f;
+        centerX.push_back(center.x); centerY.push_back(center.y); centerZ.push_back(center.z);
+        extentX.push_back(extent.x); extentY.push_back(extent.y); extentZ.push_back(extent.z);
+    }
+    // the world-space box around a transformed local box: the center is transformed, the extent goes through
+    // the absolute value of the rotation/scale part
+    void add(const glm::vec3 &min, const glm::vec3 &max, const glm::mat4 &transform)
+    {
+        glm::vec3 center = glm::vec3(transform * glm::vec4((min + max) * 0.5f, 1.0f));
+        glm::vec3 half = (max - min) * 0.5f;
+        glm::mat3 linear(transform);
+        glm::vec3 extent;
+        for (int row = 0; row < 3; row++)
+            extent[row] = std::fabs(linear[0][row]) * half.x + std::fabs(linear[1][row]) * half.y + std::fabs(linear[2][row]) * half.z;
+        add(center - extent, center + extent);
+    }
+};
+
+// bounding spheres, one array per component
+struct SphereBatch
+{
+    std::vector<float> centerX, centerY, centerZ, radius;
+
+    unsigned int size() const
+    {
+        return (unsigned int)centerX.size();
+    }
+    void clear()
+    {
+        centerX.clear(); centerY.clear(); centerZ.clear(); radius.clear();
+    }
+    void reserve(unsigned int count)
+    {
+        centerX.reserve(count); centerY.reserve(count); centerZ.reserve(count); radius.reserve(count);
+    }
+    void add(const glm::vec3 &center, float r)
+    {
+        centerX.push_back(center.x); centerY.push_back(center.y); centerZ.push_back(center.z); radius.push_back(r);
+    }
+};
+
+// bit i of the mask cull() writes is object i
+inline bool isVisible(const std::vector<std::uint64_t> &visible, unsigned int index)
+{
+    return (visible[index >> 6] >> (index & 63)) & 1;
+}
+
+class Frustum
+{
+public:
+    // left, right, bottom, top, near, far: xyz is the normal pointing into the frustum, w the offset, normalized
+    // so that dot(xyz, p) + w is the signed distance of p
+    glm::vec4 planes[6];
+
+    Frustum()
+    {
+    }
+    // extracts the planes from a combined projection * view matrix (Gribb/Hartmann); with a projection alone
+    // they come out in view space
+    explicit Frustum(const glm::mat4 &viewProjection)
+    {
+        glm::vec4 rows[4];
+        for (int row = 0; row < 4; row++)
+            rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row], viewProjection[3][row]);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            planes[axis * 2]     = rows[3] + rows[axis];
+            planes[axis * 2 + 1] = rows[3] - rows[axis];
+        }
+        for (int i = 0; i < 6; i++)
+            planes[i] /= glm::length(glm::vec3(planes[i]));
+    }
+
+    // single-object tests, for the odd query outside a batch
+    bool intersects(const glm::vec3 &min, const glm::vec3 &max) const
+    {
+        glm::vec3 center = (min + max) * 0.5f;
+        glm::vec3 extent = (max - min) * 0.5f;
+        for (int i = 0; i < 6; i++)
+        {
+            glm::vec3 normal(planes[i]);
+            if (glm::dot(normal, center) + planes[i].w + glm::dot(glm::abs(normal), extent) < 0.0f)
+                return false;
+        }
+        return true;
+    }
+    bool intersects(const glm::vec3 &center, float radius) const
+    {
+        for (int i = 0; i < 6; i++)
+            if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w + radius < 0.0f)
+                return false;
+        return true;
+    }
+
+    // tests every box against the planes and writes one bit per box into visible (resized to fit); an object
+    // is culled only when it lies entirely behind one plane, so the result is conservative. Returns the number
+    // of visible objects
+    unsigned int cull(const AABBBatch &boxes, std::vector<std::uint64_t> &visible, CullPath path = CULL_BEST) const
+    {
+        return cullBatch(boxes.size(), boxes.centerX.data(), boxes.centerY.data(), boxes.centerZ.data(), boxes.extentX.data(), boxes.extentY.data(), boxes.extentZ.data(), visible, path);
+    }
+    // same for spheres: the radius takes the place of the projected box extent
+    unsigned int cull(const SphereBatch &spheres, std::vector<std::uint64_t> &visible, CullPath path = CULL_BEST) const
+    {
+        return cullBatch(spheres.size(), spheres.centerX.data(), spheres.centerY.data(), spheres.centerZ.data(), spheres.radius.data(), NULL, NULL, visible, path);
+    }
+    // spheres [first, first + count) only, with bit i of visible for sphere first + i; for splitting a batch across threads
+    unsigned int cull(const SphereBatch &spheres, unsigned int first, unsigned int count, std::vector<std::uint64_t> &visible, CullPath path = CULL_BEST) const
+    {
+        return cullBatch(count, spheres.centerX.data() + first, spheres.centerY.data() + first, spheres.centerZ.data() + first, spheres.radius.data() + first, NULL, NULL, visible, path);
+    }
+
+    // the widest kernel this CPU can run
+    static CullPath bestPath()
+    {
+#ifdef FRUSTUM_SIMD
+        static CullPath best = __builtin_cpu_supports("avx") ? CULL_AVX : CULL_SSE;
+        return best;
+#else
+        return CULL_SCALAR;
+#endif
+    }
+
+private:
+    // one kernel for both shapes: with extentY/extentZ NULL, extentX is a radius instead of a box extent
+    unsigned int cullBatch(unsigned int count, const float *x, const float *y, const float *z, const float *ex, const float *ey, const float *ez, std::vector<std::uint64_t> &visible, CullPath path) const
+    {
+        visible.assign((count + 63) / 64, 0);
+        if (count == 0)
+            return 0;
+        if (path == CULL_BEST)
+            path = bestPath();
+        unsigned int done = 0;
+#ifdef FRUSTUM_SIMD
+        if (path == CULL_AVX)
+            done = cullAVX(count, x, y, z, ex, ey, ez, &visible[0]);
+        else if (path == CULL_SSE)
+            done = cullSSE(count, x, y, z, ex, ey, ez, &visible[0]);
+#endif
+        // the scalar loop finishes whatever the SIMD kernel left (the last count % width objects)
+        for (unsigned int i = done; i < count; i++)
+        {
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; p++)
+            {
+                const glm::vec4 &plane = planes[p];
+                float reach = ey ? std::fabs(plane.x) * ex[i] + std::fabs(plane.y) * ey[i] + std::fabs(plane.z) * ez[i] : ex[i];
+                inside = plane.x * x[i] + plane.y * y[i] + plane.z * z[i] + plane.w + reach >= 0.0f;
+            }
+            if (inside)
+                visible[i >> 6] |= (std::uint64_t)1 << (i & 63);
+        }
+        unsigned int total = 0;
+        for (unsigned int i = 0; i < visible.size(); i++)
+            total += (unsigned int)std::bitset<64>(visible[i]).count();
+        return total;
+    }
+
+#ifdef FRUSTUM_SIMD
+    // 4 objects per iteration; returns how many were handled
+    unsigned int cullSSE(unsigned int count, const float *x, const float *y, const float *z, const float *ex, const float *ey, const float *ez, std::uint64_t *visible) const
+    {
+        const __m128 zero = _mm_setzero_ps();
+        unsigned int end = count & ~3u;
+        for (unsigned int i = 0; i < end; i += 4)
+        {
+            __m128 cx = _mm_loadu_ps(x + i), cy = _mm_loadu_ps(y + i), cz = _mm_loadu_ps(z + i);
+            __m128 rx = _mm_loadu_ps(ex + i);
+            __m128 ry = ey ? _mm_loadu_ps(ey + i) : zero, rz = ez ? _mm_loadu_ps(ez + i) : zero;
+            __m128 outside = zero;
+            for (int p = 0; p < 6; p++)
+            {
+                const glm::vec4 &plane = planes[p];
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx), _mm_mul_ps(_mm_set1_ps(plane.y), cy)),
+                                             _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), cz), _mm_set1_ps(plane.w)));
+                __m128 reach = ey ? _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::fabs(plane.x)), rx), _mm_mul_ps(_mm_set1_ps(std::fabs(plane.y)), ry)),
+                                               _mm_mul_ps(_mm_set1_ps(std::fabs(plane.z)), rz))
+                                  : rx;
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), zero));
+            }
+            std::uint64_t bits = (std::uint64_t)(~_mm_movemask_ps(outside) & 0xF);
+            visible[i >> 6] |= bits << (i & 63);
+        }
+        return end;
+    }
+    // 8 objects per iteration
+    __attribute__((target("avx")))
+    unsigned int cullAVX(unsigned int count, const float *x, const float *y, const float *z, const float *ex, const float *ey, const float *ez, std::uint64_t *visible) const
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        unsigned int end = count & ~7u;
+        for (unsigned int i = 0; i < end; i += 8)
+        {
+            __m256 cx = _mm256_loadu_ps(x + i), cy = _mm256_loadu_ps(y + i), cz = _mm256_loadu_ps(z + i);
+            __m256 rx = _mm256_loadu_ps(ex + i);
+            __m256 ry = ey ? _mm256_loadu_ps(ey + i) : zero, rz = ez ? _mm256_loadu_ps(ez + i) : zero;
+            __m256 outside = zero;
+            for (int p = 0; p < 6; p++)
+            {
+                const glm::vec4 &plane = planes[p];
+                __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), cx), _mm256_mul_ps(_mm256_set1_ps(plane.y), cy)),
+                                                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), cz), _mm256_set1_ps(plane.w)));
+                __m256 reach = ey ? _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.x)), rx), _mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.y)), ry)),
+                                                  _mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.z)), rz))
+                                     : rx;
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), zero, _CMP_LT_OQ));
+            }
+            std::uint64_t bits = (std::uint64_t)(~_mm256_movemask_ps(outside) & 0xFF);
+            visible[i >> 6] |= bits << (i & 63);
+        }
+        return end;
+    }
+#endif
+};
+#endif
@@ -0,0 +1,535 @@
+/*
+One set of large vertex and index buffers per vertex layout, with every mesh of that layout suballocated from them: meshes keep offsets instead of GL names, all of them draw from the same VAO with base-vertex draws, and switching between them changes no GL state at all
+*/
+
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <vertexformat.h>
+#include <instancing.h>
+#include <glstate.h>
+
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+
+// starting size of a pool; pools double when an allocation doesn't fit
+const size_t GEOMETRY_ARENA_VERTICES = 1 << 16;
+const size_t GEOMETRY_ARENA_INDEX_BYTES = 1 << 20;
+// starting number of per-draw records, doubled the same way
+const size_t GEOMETRY_ARENA_DRAWS = 256;
+
+// first-fit allocator over [0, capacity) in whatever unit the caller counts in; freed ranges merge with their
+// neighbours
+class RangeAllocator
+{
+public:
+    size_t capacity = 0;
+    size_t used = 0;
+
+    bool allocate(size_t size, size_t alignment, size_t &offset)
+    {
+        for (std::map<size_t, size_t>::iterator it = freeRanges.begin(); it != freeRanges.end(); ++it)
+        {
+            size_t start = (it->first + alignment - 1) / alignment * alignment;
+            size_t end = it->first + it->second;
+            if (start + size > end)
+                continue;
+            size_t rangeStart = it->first;
+            freeRanges.erase(it);
+            // what's left on either side stays free
+            if (start > rangeStart)
+                freeRanges[rangeStart] = start - rangeStart;
+            if (start + size < end)
+                freeRanges[start + size] = end - (start + size);
+            used += size;
+            offset = start;
+            return true;
+        }
+        return false;
+    }
+    void free(size_t offset, size_t size)
+    {
+        if (size == 0)
+            return;
+        used -= size;
+        std::map<size_t, size_t>::iterator next = freeRanges.lower_bound(offset);
+        if (next != freeRanges.begin())
+        {
+            std::map<size_t, size_t>::iterator previous = std::prev(next);
+            if (previous->first + previous->second == offset)
+            {
+                offset = previous->first;
+                size += previous->second;
+                freeRanges.erase(previous);
+            }
+        }
+        if (next != freeRanges.end() && offset + size == next->first)
+        {
+            size += next->second;
+            freeRanges.erase(next);
+        }
+        freeRanges[offset] = size;
+    }
+    // everything below usedEnd is taken, the rest of newCapacity is one free range (after growing or compacting)
+    void reset(size_t newCapacity, size_t usedEnd)
+    {
+        capacity = newCapacity;
+        freeRanges.clear();
+        if (usedEnd < capacity)
+            freeRanges[usedEnd] = capacity - usedEnd;
+    }
+    void grow(size_t newCapacity)
+    {
+        size_t added = newCapacity - capacity;
+        capacity = newCapacity;
+        used += added;
+        free(newCapacity - added, added);
+    }
+    // free ranges the allocations are scattered between; 1 means no fragmentation
+    unsigned int fragments() const
+    {
+        return (unsigned int)freeRanges.size();
+    }
+
+private:
+    std::map<size_t, size_t> freeRanges; // offset -> size
+};
+
+// where a mesh's geometry lives in the arena: what Mesh keeps instead of GL names
+struct GeometryRange
+{
+    unsigned int id = ~0u;   // allocation slot, for range() and free()
+    unsigned int pool = 0;
+    GLint baseVertex = 0;    // added to every index by glDrawElementsBaseVertex
+    size_t vertexCount = 0;
+    size_t indexOffset = 0;  // bytes into the pool's index buffer
+    size_t indexBytes = 0;
+    bool valid() const { return id != ~0u; }
+};
+
+// the per-draw inputs of a range (DRAW_POSITION_OFFSET_LOCATION, DRAW_POSITION_SCALE_LOCATION). They sit in one array
+// for the whole arena, at the range's id, so a multi-draw finds them with baseInstance = id
+struct GeometryDrawData
+{
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f);
+};
+
+struct GeometryArenaStats
+{
+    unsigned int pools = 0;
+    unsigned int ranges = 0;
+    size_t vertexBytes = 0;      // allocated across all pools
+    size_t vertexBytesUsed = 0;
+    size_t indexBytes = 0;
+    size_t indexBytesUsed = 0;
+    unsigned int fragments = 0;  // free ranges beyond the one at the end of each buffer
+};
+
+class GeometryArena
+{
+public:
+    // bumped whenever ranges move (growing keeps offsets, defragment() doesn't); holders of a GeometryRange
+    // compare it with the generation they copied it at and fetch it again with range() when it changed
+    unsigned int generation = 1;
+    // model matrices for instanced draws of the arena's meshes (Mesh::DrawInstanced); every pool has a VAO that
+    // reads them
+    InstanceBuffer instances;
+
+    GeometryArena() = default;
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    // the arena meshes use unless they are given another one
+    static GeometryArena& shared()
+    {
+        static GeometryArena arena;
+        return arena;
+    }
+
+    // allocates room for a mesh in the pool of its layout and uploads it: the vertices come as sourceStride-sized
+    // Vertex or PackedVertex records, the indices already in their final type
+    GeometryRange add(const VertexLayout &layout, const unsigned char *source, unsigned int sourceStride, size_t vertexCount, const void *indices, size_t indexBytes, const GeometryDrawData &data = GeometryDrawData())
+    {
+        unsigned int poolIndex = poolFor(layout);
+        Pool &pool = pools[poolIndex];
+        GeometryRange range;
+        range.pool = poolIndex;
+        range.vertexCount = vertexCount;
+        range.indexBytes = indexBytes;
+        size_t vertexOffset = 0;
+        // index offsets stay 4-aligned, so any index type can start there
+        while (!pool.vertices.allocate(vertexCount, 1, vertexOffset))
+            reallocate(poolIndex, std::max(pool.vertices.capacity * 2, pool.vertices.capacity + vertexCount), pool.indices.capacity, false);
+        while (!pool.indices.allocate(indexBytes, 4, range.indexOffset))
+            reallocate(poolIndex, pool.vertices.capacity, std::max(pool.indices.capacity * 2, pool.indices.capacity + indexBytes), false);
+        range.baseVertex = (GLint)vertexOffset;
+
+        // copy the attributes of every vertex into each stream of the pool
+        for (unsigned int s = 0; s < pool.streams.size(); s++)
+        {
+            Stream &stream = pool.streams[s];
+            if (stream.stride == 0)
+                continue;
+            std::vector<unsigned char> data(vertexCount * stream.stride);
+            unsigned char *out = data.data();
+            for (size_t v = 0; v < vertexCount; v++)
+                for (unsigned int i = 0; i < stream.fields.size(); i++)
+                {
+                    std::memcpy(out, source + v * sourceStride + stream.fields[i].offset, stream.fields[i].bytes);
+                    out += stream.fields[i].bytes;
+                }
+            GLStateCache::bindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+            glBufferSubData(GL_ARRAY_BUFFER, vertexOffset * stream.stride, data.size(), data.data());
+        }
+        // the element array binding belongs to the VAO, so the index upload goes through the copy target
+        GLStateCache::bindBuffer(GL_COPY_WRITE_BUFFER, pool.indexBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, range.indexOffset, indexBytes, indices);
+
+        if (freeIds.empty())
+        {
+            range.id = (unsigned int)ranges.size();
+            ranges.push_back(range);
+            live.push_back(true);
+            drawData.push_back(data);
+        }
+        else
+        {
+            range.id = freeIds.back();
+            freeIds.pop_back();
+            ranges[range.id] = range;
+            live[range.id] = true;
+            drawData[range.id] = data;
+        }
+        if (drawData.size() > drawDataCapacity)
+            reallocateDrawData(std::max(drawDataCapacity * 2, drawData.size()));
+        GLStateCache::bindBuffer(GL_COPY_WRITE_BUFFER, drawDataBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, range.id * sizeof(GeometryDrawData), sizeof(GeometryDrawData), &data);
+        return range;
+    }
+
+    // returns a mesh's room to its pool
+    void free(const GeometryRange &range)
+    {
+        if (!range.valid() || range.id >= ranges.size() || !live[range.id])
+            return;
+        const GeometryRange &current = ranges[range.id];
+        Pool &pool = pools[current.pool];
+        pool.vertices.free(current.baseVertex, current.vertexCount);
+        pool.indices.free(current.indexOffset, current.indexBytes);
+        live[range.id] = false;
+        freeIds.push_back(range.id);
+    }
+
+    // where a range is now
+    const GeometryRange& range(unsigned int id) const
+    {
+        return ranges[id];
+    }
+    // and its per-draw inputs
+    const GeometryDrawData& data(unsigned int id) const
+    {
+        return drawData[id];
+    }
+
+    // the VAO all meshes of a pool draw with; the state cache drops the bind between meshes of the same pool
+    void bind(const GeometryRange &range) const
+    {
+        GLStateCache::bindVertexArray(pools[range.pool].VAO);
+    }
+    // the one with only the position attribute, for depth-only passes
+    void bindDepth(const GeometryRange &range) const
+    {
+        GLStateCache::bindVertexArray(pools[range.pool].depthVAO);
+    }
+    // the same two with the per-draw inputs fed from the arena's draw data by instance, for multi-draws whose
+    // commands carry the range id as their base instance; single draws keep the plain VAOs, which read the inputs'
+    // constant values
+    void bindMultiDraw(const GeometryRange &range) const
+    {
+        GLStateCache::bindVertexArray(pools[range.pool].multiDrawVAO);
+    }
+    void bindMultiDrawDepth(const GeometryRange &range) const
+    {
+        GLStateCache::bindVertexArray(pools[range.pool].multiDrawDepthVAO);
+    }
+    // the plain VAO plus a model matrix per instance from instances
+    void bindInstanced(const GeometryRange &range) const
+    {
+        GLStateCache::bindVertexArray(pools[range.pool].instancedVAO);
+    }
+
+    // moves every pool's ranges down to close the holes frees left behind; returns whether anything moved
+    bool defragment()
+    {
+        bool moved = false;
+        for (unsigned int p = 0; p < pools.size(); p++)
+        {
+            if (pools[p].vertices.fragments() <= 1 && pools[p].indices.fragments() <= 1)
+                continue;
+            reallocate(p, pools[p].vertices.capacity, pools[p].indices.capacity, true);
+            moved = true;
+        }
+        if (moved)
+            generation++;
+        return moved;
+    }
+
+    GeometryArenaStats stats() const
+    {
+        GeometryArenaStats result;
+        result.pools = (unsigned int)pools.size();
+        result.ranges = (unsigned int)(ranges.size() - freeIds.size());
+        for (unsigned int p = 0; p < pools.size(); p++)
+        {
+            const Pool &pool = pools[p];
+            unsigned int stride = 0;
+            for (unsigned int s = 0; s < pool.streams.size(); s++)
+                stride += pool.streams[s].stride;
+            result.vertexBytes += pool.vertices.capacity * stride;
+            result.vertexBytesUsed += pool.vertices.used * stride;
+            result.indexBytes += pool.indices.capacity;
+            result.indexBytesUsed += pool.indices.used;
+            result.fragments += (pool.vertices.fragments() > 1 ? pool.vertices.fragments() - 1 : 0) + (pool.indices.fragments() > 1 ? pool.indices.fragments() - 1 : 0);
+        }
+        return result;
+    }
+
+private:
+    // one vertex buffer and the fields interleaved in it
+    struct Stream
+    {
+        std::vector<VertexField> fields;
+        unsigned int stride = 0;
+        GLuint buffer = 0;
+    };
+    struct Pool
+    {
+        VertexLayout layout;
+        // the interleaved attributes; with splitPositions a second stream holds the positions alone
+        std::vector<Stream> streams;
+        VertexField position;
+        unsigned int positionStream = 0;
+        GLuint VAO = 0;
+        GLuint depthVAO = 0;
+        GLuint multiDrawVAO = 0;
+        GLuint multiDrawDepthVAO = 0;
+        GLuint instancedVAO = 0;
+        GLuint indexBuffer = 0;
+        RangeAllocator vertices; // in vertices
+        RangeAllocator indices;  // in bytes
+    };
+    std::vector<Pool> pools;
+    std::vector<GeometryRange> ranges;
+    std::vector<bool> live;
+    std::vector<unsigned int> freeIds;
+    // GeometryDrawData by range id, and the buffer the multi-draw VAOs read it from
+    std::vector<GeometryDrawData> drawData;
+    GLuint drawDataBuffer = 0;
+    size_t drawDataCapacity = 0;
+
+    unsigned int poolFor(const VertexLayout &layout)
+    {
+        for (unsigned int p = 0; p < pools.size(); p++)
+        {
+            const VertexLayout &other = pools[p].layout;
+            if (other.format == layout.format && other.attributes == layout.attributes && other.splitPositions == layout.splitPositions)
+                return p;
+        }
+        Pool pool;
+        pool.layout = layout;
+        std::vector<VertexField> fields = vertexFields(layout.format);
+        pool.position = fields[0];
+        Stream interleaved;
+        for (unsigned int i = layout.splitPositions ? 1 : 0; i < fields.size(); i++)
+            if (fields[i].attributes & layout.attributes)
+            {
+                interleaved.fields.push_back(fields[i]);
+                interleaved.stride += fields[i].bytes;
+            }
+        pool.streams.push_back(interleaved);
+        if (layout.splitPositions)
+        {
+            Stream positions;
+            positions.fields.push_back(pool.position);
+            positions.stride = pool.position.bytes;
+            pool.streams.push_back(positions);
+            pool.positionStream = 1;
+        }
+        glGenVertexArrays(1, &pool.VAO);
+        glGenVertexArrays(1, &pool.depthVAO);
+        glGenVertexArrays(1, &pool.multiDrawVAO);
+        glGenVertexArrays(1, &pool.multiDrawDepthVAO);
+        glGenVertexArrays(1, &pool.instancedVAO);
+        if (!drawDataBuffer)
+            reallocateDrawData(GEOMETRY_ARENA_DRAWS);
+        pools.push_back(pool);
+        unsigned int index = (unsigned int)pools.size() - 1;
+        reallocate(index, GEOMETRY_ARENA_VERTICES, GEOMETRY_ARENA_INDEX_BYTES, false);
+        return index;
+    }
+
+    // moves a pool into new buffers of the given capacity: as they are, or with the live ranges packed to the
+    // front (compact). Either way the VAOs are pointed at the new buffers
+    void reallocate(unsigned int poolIndex, size_t vertexCapacity, size_t indexCapacity, bool compact)
+    {
+        Pool &pool = pools[poolIndex];
+        // the pool's live ranges, and where they were before this moves them
+        std::vector<unsigned int> moved;
+        for (unsigned int id = 0; id < ranges.size(); id++)
+            if (live[id] && ranges[id].pool == poolIndex)
+                moved.push_back(id);
+        std::vector<GeometryRange> before(ranges);
+        size_t vertexEnd = 0, indexEnd = 0;
+        if (compact)
+        {
+            // the ranges keep their order, packed from the start of the buffer
+            std::sort(moved.begin(), moved.end(), [&](unsigned int a, unsigned int b) { return ranges[a].baseVertex < ranges[b].baseVertex; });
+            for (unsigned int i = 0; i < moved.size(); i++)
+            {
+                ranges[moved[i]].baseVertex = (GLint)vertexEnd;
+                vertexEnd += ranges[moved[i]].vertexCount;
+            }
+            std::sort(moved.begin(), moved.end(), [&](unsigned int a, unsigned int b) { return ranges[a].indexOffset < ranges[b].indexOffset; });
+            for (unsigned int i = 0; i < moved.size(); i++)
+            {
+                ranges[moved[i]].indexOffset = indexEnd;
+                indexEnd += (ranges[moved[i]].indexBytes + 3) / 4 * 4;
+            }
+        }
+
+        for (unsigned int s = 0; s < pool.streams.size(); s++)
+        {
+            Stream &stream = pool.streams[s];
+            GLuint buffer;
+            glGenBuffers(1, &buffer);
+            GLStateCache::bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity * stream.stride, NULL, GL_STATIC_DRAW);
+            if (stream.buffer && stream.stride > 0)
+            {
+                GLStateCache::bindBuffer(GL_COPY_READ_BUFFER, stream.buffer);
+                if (compact)
+                {
+                    for (unsigned int i = 0; i < moved.size(); i++)
+                        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, before[moved[i]].baseVertex * stream.stride, ranges[moved[i]].baseVertex * stream.stride, ranges[moved[i]].vertexCount * stream.stride);
+                }
+                else if (pool.vertices.capacity * stream.stride > 0)
+                    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, pool.vertices.capacity * stream.stride);
+                GLStateCache::forgetBuffer(stream.buffer);
+                glDeleteBuffers(1, &stream.buffer);
+            }
+            stream.buffer = buffer;
+        }
+        GLuint indexBuffer;
+        glGenBuffers(1, &indexBuffer);
+        GLStateCache::bindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity, NULL, GL_STATIC_DRAW);
+        if (pool.indexBuffer)
+        {
+            GLStateCache::bindBuffer(GL_COPY_READ_BUFFER, pool.indexBuffer);
+            if (compact)
+            {
+                for (unsigned int i = 0; i < moved.size(); i++)
+                    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, before[moved[i]].indexOffset, ranges[moved[i]].indexOffset, ranges[moved[i]].indexBytes);
+            }
+            else if (pool.indices.capacity > 0)
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, pool.indices.capacity);
+            GLStateCache::forgetBuffer(pool.indexBuffer);
+            glDeleteBuffers(1, &pool.indexBuffer);
+        }
+        pool.indexBuffer = indexBuffer;
+
+        if (compact)
+        {
+            pool.vertices.reset(vertexCapacity, vertexEnd);
+            pool.indices.reset(indexCapacity, indexEnd);
+        }
+        else
+        {
+            pool.vertices.grow(vertexCapacity);
+            pool.indices.grow(indexCapacity);
+        }
+        pointAttributes(pool);
+    }
+
+    // a larger draw data buffer, with every pool's multi-draw VAOs pointed at it
+    void reallocateDrawData(size_t capacity)
+    {
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        GLStateCache::bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity * sizeof(GeometryDrawData), NULL, GL_STATIC_DRAW);
+        if (drawDataBuffer)
+        {
+            GLStateCache::bindBuffer(GL_COPY_READ_BUFFER, drawDataBuffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, drawDataCapacity * sizeof(GeometryDrawData));
+            GLStateCache::forgetBuffer(drawDataBuffer);
+            glDeleteBuffers(1, &drawDataBuffer);
+        }
+        drawDataBuffer = buffer;
+        drawDataCapacity = capacity;
+        for (unsigned int p = 0; p < pools.size(); p++)
+            pointAttributes(pools[p]);
+    }
+
+    void pointAttributes(const Pool &pool)
+    {
+        // the multi-draw VAOs are the plain ones plus the per-draw inputs, one record per instance; the instanced
+        // one is the plain one plus a model matrix per instance
+        const GLuint vertexArrays[] = { pool.VAO, pool.multiDrawVAO, pool.instancedVAO };
+        for (unsigned int a = 0; a < 3; a++)
+        {
+            GLStateCache::bindVertexArray(vertexArrays[a]);
+            GLStateCache::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.indexBuffer);
+            for (unsigned int s = 0; s < pool.streams.size(); s++)
+            {
+                const Stream &stream = pool.streams[s];
+                if (stream.stride == 0)
+                    continue;
+                GLStateCache::bindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+                size_t offset = 0;
+                for (unsigned int i = 0; i < stream.fields.size(); i++)
+                {
+                    pointVertexField(stream.fields[i], stream.stride, offset);
+                    offset += stream.fields[i].bytes;
+                }
+            }
+        }
+        // the position is the first field of whichever stream holds it
+        const GLuint depthVertexArrays[] = { pool.depthVAO, pool.multiDrawDepthVAO };
+        for (unsigned int a = 0; a < 2; a++)
+        {
+            GLStateCache::bindVertexArray(depthVertexArrays[a]);
+            GLStateCache::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.indexBuffer);
+            GLStateCache::bindBuffer(GL_ARRAY_BUFFER, pool.streams[pool.positionStream].buffer);
+            pointVertexField(pool.position, pool.streams[pool.positionStream].stride, 0);
+        }
+        GLStateCache::bindVertexArray(pool.multiDrawVAO);
+        pointDrawData();
+        GLStateCache::bindVertexArray(pool.multiDrawDepthVAO);
+        pointDrawData();
+        GLStateCache::bindVertexArray(pool.instancedVAO);
+        instances.attach();
+        GLStateCache::bindVertexArray(0);
+    }
+
+    // the per-draw inputs of the bound VAO, advancing once per instance
+    void pointDrawData() const
+    {
+        GLStateCache::bindBuffer(GL_ARRAY_BUFFER, drawDataBuffer);
+        glEnableVertexAttribArray(DRAW_POSITION_OFFSET_LOCATION);
+        glVertexAttribPointer(DRAW_POSITION_OFFSET_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(GeometryDrawData), (void*)offsetof(GeometryDrawData, positionOffset));
+        glVertexAttribDivisor(DRAW_POSITION_OFFSET_LOCATION, 1);
+        glEnableVertexAttribArray(DRAW_POSITION_SCALE_LOCATION);
+        glVertexAttribPointer(DRAW_POSITION_SCALE_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(GeometryDrawData), (void*)offsetof(GeometryDrawData, positionScale));
+        glVertexAttribDivisor(DRAW_POSITION_SCALE_LOCATION, 1);
+    }
+};
+#endif
@@ -0,0 +1,253 @@
+/*
+A shadow copy of the GL binding state (program, VAO, buffers, texture units, enable flags, constant attribute values) so that binds which would not change anything are never sent to the driver
+*/
+
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+// how many texture units are shadowed; binds on higher units go straight through
+const unsigned int GL_STATE_TEXTURE_UNITS = 32;
+// and how many generic vertex attributes have their constant value shadowed
+const unsigned int GL_STATE_VERTEX_ATTRIBUTES = 16;
+
+// per-frame counters, reset by the render loop
+struct GLStateStats
+{
+    unsigned int issued = 0; // calls that reached the driver
+    unsigned int elided = 0; // calls skipped because the state already matched
+};
+
+// Everything is static: there is one context, and the shadow has to be shared by every Shader, Mesh and texture
+// loader that binds through it. Code that binds with raw gl* calls afterwards must call invalidate().
+class GLStateCache
+{
+public:
+    // forgets everything, so the next call of each kind is issued
+    static void invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (unsigned int i = 0; i < BUFFER_TARGETS; i++)
+            buffers[i] = UNKNOWN;
+        for (unsigned int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+            for (unsigned int i = 0; i < TEXTURE_TARGETS; i++)
+                textures[unit][i] = UNKNOWN;
+        for (unsigned int i = 0; i < CAPABILITIES; i++)
+            enabled[i] = UNKNOWN;
+        for (unsigned int i = 0; i < GL_STATE_VERTEX_ATTRIBUTES; i++)
+            attributeKnown[i] = false;
+    }
+
+    static void useProgram(GLuint id)
+    {
+        if (program == known(id))
+            return elide();
+        glUseProgram(id);
+        program = known(id);
+        issue();
+    }
+    static void bindVertexArray(GLuint id)
+    {
+        if (vertexArray == known(id))
+            return elide();
+        glBindVertexArray(id);
+        vertexArray = known(id);
+        // the element array binding is part of the VAO, so it changes along with it
+        buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+        issue();
+    }
+    static void bindBuffer(GLenum target, GLuint id)
+    {
+        int slot = bufferSlot(target);
+        if (slot >= 0 && buffers[slot] == known(id))
+            return elide();
+        glBindBuffer(target, id);
+        if (slot >= 0)
+            buffers[slot] = known(id);
+        issue();
+    }
+    // indexed binds are never elided (offsets move every frame), but they also bind the generic target
+    static void bindBufferRange(GLenum target, GLuint index, GLuint id, GLintptr offset, GLsizeiptr size)
+    {
+        glBindBufferRange(target, index, id, offset, size);
+        int slot = bufferSlot(target);
+        if (slot >= 0)
+            buffers[slot] = known(id);
+        issue();
+    }
+    static void activeTexture(GLuint unit)
+    {
+        if (activeUnit == known(unit))
+            return elide();
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = known(unit);
+        issue();
+    }
+    // binds on the active unit, like glBindTexture
+    static void bindTexture(GLenum target, GLuint id)
+    {
+        int slot = textureSlot(target);
+        GLuint unit = activeUnit - 1;
+        if (slot < 0 || activeUnit == UNKNOWN || unit >= GL_STATE_TEXTURE_UNITS)
+        {
+            glBindTexture(target, id);
+            return issue();
+        }
+        if (textures[unit][slot] == known(id))
+            return elide();
+        glBindTexture(target, id);
+        textures[unit][slot] = known(id);
+        issue();
+    }
+    // binds on the given unit, only switching the active unit when the bind really has to happen
+    static void bindTextureUnit(GLuint unit, GLenum target, GLuint id)
+    {
+        int slot = textureSlot(target);
+        if (slot >= 0 && unit < GL_STATE_TEXTURE_UNITS && textures[unit][slot] == known(id))
+            return elide();
+        activeTexture(unit);
+        bindTexture(target, id);
+    }
+    // the value an attribute reads while its array is disabled in the bound VAO; context state, not VAO state
+    static void vertexAttrib(GLuint index, float x, float y, float z)
+    {
+        if (index < GL_STATE_VERTEX_ATTRIBUTES && attributeKnown[index] && attributes[index][0] == x && attributes[index][1] == y && attributes[index][2] == z)
+            return elide();
+        glVertexAttrib3f(index, x, y, z);
+        if (index < GL_STATE_VERTEX_ATTRIBUTES)
+        {
+            attributes[index][0] = x;
+            attributes[index][1] = y;
+            attributes[index][2] = z;
+            attributeKnown[index] = true;
+        }
+        issue();
+    }
+    static void enable(GLenum capability)
+    {
+        setCapability(capability, true);
+    }
+    static void disable(GLenum capability)
+    {
+        setCapability(capability, false);
+    }
+
+    // objects being deleted must not linger in the shadow, or a new object reusing the name would be skipped
+    static void forgetProgram(GLuint id)
+    {
+        if (program == known(id))
+            program = UNKNOWN;
+    }
+    static void forgetVertexArray(GLuint id)
+    {
+        if (vertexArray == known(id))
+            vertexArray = UNKNOWN;
+    }
+    static void forgetBuffer(GLuint id)
+    {
+        for (unsigned int i = 0; i < BUFFER_TARGETS; i++)
+            if (buffers[i] == known(id))
+                buffers[i] = UNKNOWN;
+    }
+    static void forgetTexture(GLuint id)
+    {
+        for (unsigned int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+            for (unsigned int i = 0; i < TEXTURE_TARGETS; i++)
+                if (textures[unit][i] == known(id))
+                    textures[unit][i] = UNKNOWN;
+    }
+
+    static GLStateStats& frameStats()
+    {
+        return stats;
+    }
+    static void resetFrameStats()
+    {
+        stats = GLStateStats();
+    }
+
+private:
+    // the shadow stores name + 1, so that 0 (what the arrays start out as) means "unknown, always issue"
+    static const GLuint UNKNOWN = 0;
+    static const unsigned int BUFFER_TARGETS = 5;
+    static const unsigned int TEXTURE_TARGETS = 3;
+    static const unsigned int CAPABILITIES = 8;
+
+    static inline GLuint program = UNKNOWN;
+    static inline GLuint vertexArray = UNKNOWN;
+    static inline GLuint activeUnit = UNKNOWN;
+    static inline GLuint buffers[BUFFER_TARGETS] = {};
+    static inline GLuint textures[GL_STATE_TEXTURE_UNITS][TEXTURE_TARGETS] = {};
+    static inline GLuint enabled[CAPABILITIES] = {};
+    static inline float attributes[GL_STATE_VERTEX_ATTRIBUTES][3] = {};
+    static inline bool attributeKnown[GL_STATE_VERTEX_ATTRIBUTES] = {};
+    static inline GLStateStats stats;
+
+    static GLuint known(GLuint value)
+    {
+        return value + 1;
+    }
+
+    static void issue()
+    {
+        stats.issued++;
+    }
+    static void elide()
+    {
+        stats.elided++;
+    }
+    static int bufferSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_ARRAY_BUFFER:         return 0;
+        case GL_ELEMENT_ARRAY_BUFFER: return 1;
+        case GL_UNIFORM_BUFFER:       return 2;
+        case GL_DRAW_INDIRECT_BUFFER: return 3;
+        case GL_COPY_WRITE_BUFFER:    return 4;
+        default:                      return -1;
+        }
+    }
+    static int textureSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_TEXTURE_2D:       return 0;
+        case GL_TEXTURE_CUBE_MAP: return 1;
+        case GL_TEXTURE_2D_ARRAY: return 2;
+        default:                  return -1;
+        }
+    }
+    static int capabilitySlot(GLenum capability)
+    {
+        switch (capability)
+        {
+        case GL_DEPTH_TEST:          return 0;
+        case GL_CULL_FACE:           return 1;
+        case GL_BLEND:               return 2;
+        case GL_STENCIL_TEST:        return 3;
+        case GL_SCISSOR_TEST:        return 4;
+        case GL_POLYGON_OFFSET_FILL: return 5;
+        case GL_FRAMEBUFFER_SRGB:    return 6;
+        case GL_MULTISAMPLE:         return 7;
+        default:                     return -1;
+        }
+    }
+    static void setCapability(GLenum capability, bool on)
+    {
+        int slot = capabilitySlot(capability);
+        if (slot >= 0 && enabled[slot] == known(on))
+            return elide();
+        if (on)
+            glEnable(capability);
+        else
+            glDisable(capability);
+        if (slot >= 0)
+            enabled[slot] = known(on);
+        issue();
+    }
+};
+#endif
@@ -0,0 +1,161 @@
+/*
+Input as data: window callbacks push timestamped events into a lock-free queue instead of touching the camera, the simulation drains them once per step, and a session can be recorded to a file and replayed step for step so benchmark runs follow the same camera path every time
+*/
+
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+
+#include <spscqueue.h>
+#include <camera.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <chrono>
+#include <cstdint>
+#include <atomic>
+#include <iostream>
+
+enum InputEventType
+{
+    INPUT_MOUSE_MOVE, // x, y: cursor offsets, already flipped so that +y looks up
+    INPUT_SCROLL,     // y: wheel offset
+    INPUT_MOVE        // code: Camera_Movement, x: the step length in seconds it was held for
+};
+
+// fixed size and plain data, so recordings are the events written as they are
+struct InputEvent
+{
+    double time;        // seconds since the queue was created, when the event was pushed
+    std::uint32_t step; // simulation step that consumed it, filled in by consume()
+    std::uint32_t type; // InputEventType
+    std::int32_t code;
+    float x;
+    float y;
+};
+
+// feeds one event to a camera, the way the callbacks used to
+inline void applyToCamera(const InputEvent &event, Camera &camera)
+{
+    switch (event.type)
+    {
+    case INPUT_MOUSE_MOVE:
+        camera.ProcessMouseMovement(event.x, event.y);
+        break;
+    case INPUT_SCROLL:
+        camera.ProcessMouseScroll(event.y);
+        break;
+    case INPUT_MOVE:
+        camera.ProcessKeyboard((Camera_Movement)event.code, event.x);
+        break;
+    }
+}
+
+// recording file layout: INPUT_RECORDING_MAGIC, then InputEvents until the end of the file
+const std::uint32_t INPUT_RECORDING_MAGIC = 0x31504e49; // "INP1"
+
+class InputQueue
+{
+public:
+    InputQueue() : created(std::chrono::steady_clock::now()), step(0), droppedEvents(0), replayAt(0), replayMode(false)
+    {
+    }
+    InputQueue(const InputQueue&) = delete;
+    InputQueue& operator=(const InputQueue&) = delete;
+
+    // producer side, called from the window callbacks; while replaying, live input is ignored
+    void push(InputEventType type, int code, float x, float y)
+    {
+        if (replayMode)
+            return;
+        InputEvent event = { seconds(), 0, (std::uint32_t)type, code, x, y };
+        if (!events.push(event))
+            droppedEvents.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // consumer side, once per simulation step: hands every event of this step to handle(const InputEvent&) in
+    // the order they happened, appending them to the recording if there is one
+    template <typename Handler>
+    void consume(Handler handle)
+    {
+        InputEvent event;
+        if (replayMode)
+        {
+            for (; replayAt < replayEvents.size() && replayEvents[replayAt].step <= step; replayAt++)
+                handle(replayEvents[replayAt]);
+        }
+        else
+        {
+            while (events.pop(event))
+            {
+                event.step = step;
+                if (recording)
+                    recording.write((const char*)&event, sizeof(event));
+                handle(event);
+            }
+        }
+        step++;
+    }
+
+    // starts writing every consumed event to path
+    bool record(const std::string &path)
+    {
+        recording.open(path, std::ios::binary | std::ios::trunc);
+        if (!recording)
+        {
+            std::cout << "ERROR::INPUT::RECORDING_NOT_WRITABLE: " << path << std::endl;
+            return false;
+        }
+        recording.write((const char*)&INPUT_RECORDING_MAGIC, sizeof(INPUT_RECORDING_MAGIC));
+        return true;
+    }
+    // replaces live input by a recording; step N of this run gets exactly the events step N of the recorded run got
+    bool replay(const std::string &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::uint32_t magic = 0;
+        file.read((char*)&magic, sizeof(magic));
+        if (!file || magic != INPUT_RECORDING_MAGIC)
+        {
+            std::cout << "ERROR::INPUT::NOT_A_RECORDING: " << path << std::endl;
+            return false;
+        }
+        replayEvents.clear();
+        InputEvent event;
+        while (file.read((char*)&event, sizeof(event)))
+            replayEvents.push_back(event);
+        replayAt = 0;
+        replayMode = true;
+        return true;
+    }
+    bool replaying() const
+    {
+        return replayMode;
+    }
+    // true once a replay has handed out its last event
+    bool replayFinished() const
+    {
+        return replayMode && replayAt >= replayEvents.size();
+    }
+    // events lost because the consumer fell more than the queue's capacity behind
+    unsigned int dropped() const
+    {
+        return droppedEvents.load(std::memory_order_relaxed);
+    }
+
+private:
+    SPSCQueue<InputEvent, 1024> events;
+    std::chrono::steady_clock::time_point created;
+    std::uint32_t step;
+    std::atomic<unsigned int> droppedEvents; // bumped by the producer
+    std::ofstream recording;
+    std::vector<InputEvent> replayEvents;
+    unsigned int replayAt;
+    bool replayMode;
+
+    double seconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - created).count();
+    }
+};
+#endif
@@ -0,0 +1,16 @@
+// the model matrix: a uniform, or with INSTANCED (SHADER_INSTANCED) one per instance from the InstanceBuffer
+// attached to the VAO (instancing.h), so the same source serves single and instanced draws
+#ifdef INSTANCED
+layout (location = 9) in mat4 aInstanceModel;
+#else
+uniform mat4 model;
+#endif
+
+mat4 modelMatrix()
+{
+#ifdef INSTANCED
+    return aInstanceModel;
+#else
+    return model;
+#endif
+}
@@ -0,0 +1,65 @@
+/*
+Per-instance model matrices streamed into a vertex buffer and read through an attribute divisor, so that N copies of a mesh are one instanced draw instead of N draws with N uniform uploads
+*/
+
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <glstate.h>
+
+#include <cstddef>
+
+// location of the per-instance model matrix instancing.glsl declares; a mat4 takes this one and the three after it
+const GLuint INSTANCE_MODEL_LOCATION = 9;
+
+class InstanceBuffer
+{
+public:
+    GLuint buffer = 0;
+    // transforms in the last upload
+    size_t count = 0;
+
+    // replaces the transforms. The store is orphaned on every upload, so writing this frame's matrices never waits
+    // for draws still reading the previous ones, and the VAOs attached to the buffer stay valid whatever the size
+    void upload(const glm::mat4 *transforms, size_t count)
+    {
+        create();
+        GLStateCache::bindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::mat4), transforms, GL_STREAM_DRAW);
+        this->count = count;
+    }
+
+    // points the model matrix of the bound VAO at this buffer, advancing once per instance
+    void attach()
+    {
+        create();
+        GLStateCache::bindBuffer(GL_ARRAY_BUFFER, buffer);
+        for (GLuint column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(INSTANCE_MODEL_LOCATION + column);
+            glVertexAttribPointer(INSTANCE_MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(INSTANCE_MODEL_LOCATION + column, 1);
+        }
+    }
+
+    // the raw-VAO path: uploads the transforms and draws one instance of the VAO's vertices per transform. The VAO
+    // must have been bound while attach() was called
+    void drawArrays(GLuint VAO, GLenum mode, GLint first, GLsizei vertexCount, const glm::mat4 *transforms, size_t count)
+    {
+        upload(transforms, count);
+        GLStateCache::bindVertexArray(VAO);
+        glDrawArraysInstanced(mode, first, vertexCount, (GLsizei)count);
+    }
+
+private:
+    void create()
+    {
+        if (!buffer)
+            glGenBuffers(1, &buffer);
+    }
+};
+#endif
@@ -0,0 +1,38 @@
+/*
+The process's resident set size as the OS reports it, now and at its peak, so a sample can show what loading costs in RAM and what stays behind once the meshes are on the GPU. Read from /proc/self/status, so only Linux reports it; elsewhere both are zero
+*/
+
+#ifndef MEMORY_USAGE_H
+#define MEMORY_USAGE_H
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+struct MemoryUsage
+{
+    size_t residentBytes = 0; // VmRSS
+    size_t peakBytes = 0;     // VmHWM, the highest the RSS has been
+};
+
+inline MemoryUsage processMemoryUsage()
+{
+    MemoryUsage usage;
+#ifdef __linux__
+    FILE *status = std::fopen("/proc/self/status", "r");
+    if (!status)
+        return usage;
+    char line[256];
+    while (std::fgets(line, sizeof(line), status))
+    {
+        unsigned long kilobytes = 0;
+        if (std::strncmp(line, "VmRSS:", 6) == 0 && std::sscanf(line + 6, "%lu", &kilobytes) == 1)
+            usage.residentBytes = (size_t)kilobytes * 1024;
+        else if (std::strncmp(line, "VmHWM:", 6) == 0 && std::sscanf(line + 6, "%lu", &kilobytes) == 1)
+            usage.peakBytes = (size_t)kilobytes * 1024;
+    }
+    std::fclose(status);
+#endif
+    return usage;
+}
+#endif
@@ -7,140 +7,374 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <shaders.h>
+#include <glstate.h>
+#include <shadervariants.h>
+#include <vertexformat.h>
+#include <geometryarena.h>
+#include <textureroles.h>
+#include <meshlets.h>
+#include <meshlod.h>
 
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <utility>
 using namespace std;
 
-#define MAX_BONE_INFLUENCE 4
-
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texCoords
-    glm::vec2 TexCoords;
-    // tangent
-    glm::vec3 Tangent;
-    // bitangent
-    glm::vec3 Bitangent;
-	//bone indexes which will influence this vertex
-	int m_BoneIDs[MAX_BONE_INFLUENCE];
-	//weights from each bone
-	float m_Weights[MAX_BONE_INFLUENCE];
-};
-
 struct Texture {
     unsigned int id;
     string type;
     string path;
+    TextureRole role = TEXTURE_ROLE_COUNT; // from type; Mesh fills it in
 };
 
+// what a mesh keeps in RAM once its geometry is in the arena
+enum MeshResidency
+{
+    MESH_KEEP_CPU_COPY,    // vertices and indices, e.g. for meshes that get reprocessed on the CPU
+    MESH_RELEASE_CPU_COPY, // nothing; the GPU copy is the only one
+    MESH_KEEP_POSITIONS    // positions (12 bytes a vertex instead of 88) and indices, for picking and collision
+};
+const char* const MESH_RESIDENCY_NAMES[] = { "keep", "release", "positions" };
+
 class Mesh {
 public:
-    // mesh Data
+    // mesh Data, as far as the residency keeps it
     vector<Vertex>       vertices;
+    // 32-bit on the CPU, like the full-float vertices; the index buffer uses indexType
     vector<unsigned int> indices;
     vector<Texture>      textures;
-    unsigned int VAO;
+    // the vertex positions alone, with MESH_KEEP_POSITIONS
+    vector<glm::vec3>    positions;
+    MeshResidency        residency;
+    // what was uploaded, which stays valid whatever the residency dropped
+    size_t vertexCount, indexCount;
+    // where the vertices and indices live in the arena; the arena owns the GL buffers and VAOs
+    GeometryArena *arena;
+    GeometryRange geometry;
+    // local-space bounding box of the vertices, for culling
+    glm::vec3 boundsMin, boundsMax;
+    // the triangles in clusters with their own bounds, for culling finer than the whole mesh; full detail only
+    MeshletSet meshlets;
+    // detail levels as slices of the index buffer, the full one first, and the one the draws use
+    vector<MeshLod> lods;
+    unsigned int lod = 0;
+    // what the vertex buffers hold, and how their positions map back to local space: offset + scale * stored
+    VertexLayout layout;
+    glm::vec3 positionOffset, positionScale;
+    // GL_UNSIGNED_BYTE/SHORT/INT, whichever is the narrowest that fits the vertex count
+    GLenum indexType;
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor; the vectors are taken over, so callers move them in rather than have them copied. With lods the
+    // indices hold every level back to back (buildLodChain), without them the indices are the one level
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, VertexLayout layout = VertexLayout(), MeshResidency residency = MESH_KEEP_CPU_COPY, GeometryArena &arena = GeometryArena::shared(), vector<MeshLod> lods = vector<MeshLod>())
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->arena = &arena;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        this->residency = residency;
+        this->lods = std::move(lods);
+        if (this->lods.empty())
+        {
+            this->lods.resize(1);
+            this->lods[0].indexCount = (unsigned int)this->indices.size();
+        }
+        this->layout = layout;
+        this->layout.attributes |= VERTEX_POSITION;
 
+        computeBounds();
+        buildMeshlets(meshlets, this->indices, this->lods[0].indexCount, this->vertices);
+        // give every texture its role and unit, and its sampler its name (texture_diffuseN, ...), once up front
+        assignSamplers();
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
+        applyResidency();
     }
 
-    // render the mesh
-    void Draw(Shader &shader) 
+    // move-only: a copy would be a second owner of the same arena range, and copying the arrays is never wanted
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+    Mesh(Mesh&&) noexcept = default;
+    Mesh& operator=(Mesh&&) noexcept = default;
+
+    // shader features this mesh's material needs, for picking a program from ShaderVariants
+    unsigned int features() const
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
+        unsigned int mask = 0;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to string
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to string
-             else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to string
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            if(textures[i].role == TEXTURE_NORMAL)
+                mask |= SHADER_NORMAL_MAP;
+            else if(textures[i].role == TEXTURE_SPECULAR)
+                mask |= SHADER_SPECULAR_MAP;
         }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        if(layout.format != VERTEX_FORMAT_FLOAT)
+            mask |= SHADER_PACKED_VERTICES;
+        return mask;
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // bytes the vertex buffer takes on the GPU
+    size_t vertexBufferBytes() const
+    {
+        return vertexCount * vertexStride(layout.format, layout.attributes);
+    }
+    // and the index buffer
+    size_t indexBufferBytes() const
+    {
+        return indexCount * indexSize(indexType);
+    }
+    // and the RAM the CPU copies take
+    size_t cpuGeometryBytes() const
+    {
+        return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int) + positions.capacity() * sizeof(glm::vec3);
+    }
+
+    // render the mesh
+    void Draw(Shader &shader) 
+    {
+        BindMaterial(shader);
+        bindDrawData();
+        // draw mesh; every mesh of the same layout draws from the same VAO, so only the first of them binds it
+        const GeometryRange &range = currentGeometry();
+        arena->bind(range);
+        glDrawElementsBaseVertex(GL_TRIANGLES, lodIndexCount(), indexType, (void*)lodIndexOffset(range), range.baseVertex);
+    }
+
+    // draws count copies, with the model matrices last uploaded to the arena's instance buffer; the program must be
+    // built with INSTANCED (SHADER_INSTANCED)
+    void DrawInstanced(Shader &shader, GLsizei count)
+    {
+        BindMaterial(shader);
+        bindDrawData();
+        const GeometryRange &range = currentGeometry();
+        arena->bindInstanced(range);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lodIndexCount(), indexType, (void*)lodIndexOffset(range), count, range.baseVertex);
+    }
+
+    // binds the textures on their units; DrawBatch does this once for every group of meshes with the same textures
+    void BindMaterial(Shader &shader)
+    {
+        // the samplers are pointed at their units once per program, not once per draw
+        if (samplerShader != &shader || samplerGeneration != shader.generation)
+            resolveSamplers(shader);
+        // the state cache only switches units when the binding really changes
+        for(unsigned int i = 0; i < samplerSlots.size(); i++)
+            GLStateCache::bindTextureUnit(samplerSlots[i].unit, GL_TEXTURE_2D, samplerSlots[i].texture);
+    }
+
+    // draws the meshlets that survive culling against a frustum and camera position in the mesh's local space, as
+    // one multi-draw of the ranges they leave; cones is false where the transform mirrors the mesh. The meshlets
+    // are the full-detail level's, whatever lod says
+    const MeshletCullStats& DrawMeshlets(Shader &shader, MeshletCuller &culler, const Frustum &localFrustum, const glm::vec3 &localCamera, bool cones = true)
+    {
+        const GeometryRange &range = currentGeometry();
+        culler.cull(meshlets, localFrustum, localCamera, cones, range.indexOffset, indexSize(indexType), range.baseVertex);
+        if (culler.counts.empty())
+            return culler.stats();
+        BindMaterial(shader);
+        bindDrawData();
+        arena->bind(range);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, culler.counts.data(), indexType, culler.offsets.data(), (GLsizei)culler.counts.size(), culler.baseVertices.data());
+        return culler.stats();
+    }
+
+    // render positions only, for depth and shadow passes: no textures, and with splitPositions nothing but the
+    // position buffer is fetched (12 bytes a vertex as floats). The program only needs to be made current
+    void DrawDepth(Shader &shader)
+    {
+        shader.use();
+        bindDrawData();
+        const GeometryRange &range = currentGeometry();
+        arena->bindDepth(range);
+        glDrawElementsBaseVertex(GL_TRIANGLES, lodIndexCount(), indexType, (void*)lodIndexOffset(range), range.baseVertex);
+    }
+
+    // the current level's slice of the index buffer
+    GLsizei lodIndexCount() const
+    {
+        return (GLsizei)lods[lod].indexCount;
+    }
+    size_t lodIndexOffset(const GeometryRange &range) const
+    {
+        return range.indexOffset + (size_t)lods[lod].firstIndex * indexSize(indexType);
+    }
+
+    // gives the mesh's room in the arena back; the mesh can't be drawn afterwards
+    void Release()
+    {
+        arena->free(geometry);
+        geometry = GeometryRange();
+    }
+
+    // the range as it is now, fetched again when the arena moved things (GeometryArena::defragment)
+    const GeometryRange& currentGeometry()
+    {
+        if (geometryGeneration != arena->generation)
+        {
+            geometry = arena->range(geometry.id);
+            geometryGeneration = arena->generation;
+        }
+        return geometry;
     }
 
 private:
-    // render data 
-    unsigned int VBO, EBO;
+    // arena generation the geometry range was copied at
+    unsigned int geometryGeneration = 0;
+    // a texture the mesh binds, and the unit its role and number put it on
+    struct SamplerSlot
+    {
+        GLuint unit;
+        GLuint texture;
+    };
+    vector<SamplerSlot> samplerSlots;
+    // the sampler uniform of each slot, only looked up when a new program is seen
+    vector<string>      samplerNames;
+    // the program they were last pointed at: the Shader and its generation, not the GL name, which GL may hand out
+    // again once swapProgram() deletes a program
+    const Shader       *samplerShader = NULL;
+    unsigned int        samplerGeneration = 0;
+
+    // how the stored positions map back to local space (identity for the float format), as the constant values of
+    // the per-draw inputs; meshes of one format share them, so the state cache drops most of these
+    void bindDrawData() const
+    {
+        GLStateCache::vertexAttrib(DRAW_POSITION_OFFSET_LOCATION, positionOffset.x, positionOffset.y, positionOffset.z);
+        GLStateCache::vertexAttrib(DRAW_POSITION_SCALE_LOCATION, positionScale.x, positionScale.y, positionScale.z);
+    }
+
+    void computeBounds()
+    {
+        boundsMin = boundsMax = vertices.empty() ? glm::vec3(0.0f) : vertices[0].Position;
+        for(unsigned int i = 1; i < vertices.size(); i++)
+        {
+            boundsMin = glm::min(boundsMin, vertices[i].Position);
+            boundsMax = glm::max(boundsMax, vertices[i].Position);
+        }
+        positionOffset = glm::vec3(0.0f);
+        positionScale = glm::vec3(1.0f);
+        if(layout.format == VERTEX_FORMAT_HALF)
+            positionOffset = (boundsMin + boundsMax) * 0.5f;
+        else if(layout.format == VERTEX_FORMAT_UNORM16)
+        {
+            positionOffset = boundsMin;
+            positionScale = boundsMax - boundsMin;
+        }
+    }
+
+    // converts the vertices to the 32-byte PackedVertex of the mesh's format
+    vector<PackedVertex> packVertices() const
+    {
+        vector<PackedVertex> packed(vertices.size());
+        for(unsigned int i = 0; i < vertices.size(); i++)
+        {
+            const Vertex &v = vertices[i];
+            PackedVertex &p = packed[i];
+            glm::vec3 position = v.Position - positionOffset;
+            for(unsigned int c = 0; c < 3; c++)
+            {
+                if(layout.format == VERTEX_FORMAT_HALF)
+                    p.Position[c] = glm::packHalf1x16(position[c]);
+                else
+                    p.Position[c] = glm::packUnorm1x16(positionScale[c] > 0.0f ? position[c] / positionScale[c] : 0.0f);
+            }
+            p.Position[3] = 0;
+            glm::vec2 normal = encodeOctahedral(glm::dot(v.Normal, v.Normal) > 0.0f ? v.Normal : glm::vec3(0.0f, 0.0f, 1.0f));
+            p.Normal[0] = (int16_t)glm::packSnorm1x16(normal.x);
+            p.Normal[1] = (int16_t)glm::packSnorm1x16(normal.y);
+            p.TexCoords[0] = glm::packHalf1x16(v.TexCoords.x);
+            p.TexCoords[1] = glm::packHalf1x16(v.TexCoords.y);
+            glm::quat frame = encodeTangentFrame(glm::dot(v.Normal, v.Normal) > 0.0f ? v.Normal : glm::vec3(0.0f, 0.0f, 1.0f), v.Tangent, v.Bitangent);
+            p.TangentFrame[0] = (int16_t)glm::packSnorm1x16(frame.x);
+            p.TangentFrame[1] = (int16_t)glm::packSnorm1x16(frame.y);
+            p.TangentFrame[2] = (int16_t)glm::packSnorm1x16(frame.z);
+            p.TangentFrame[3] = (int16_t)glm::packSnorm1x16(frame.w);
+            for(unsigned int j = 0; j < MAX_BONE_INFLUENCE; j++)
+            {
+                // an index past 255 cannot be stored; such an influence is dropped rather than pointed at another bone
+                bool stored = v.m_BoneIDs[j] >= 0 && v.m_BoneIDs[j] <= 255;
+                p.m_BoneIDs[j] = stored ? (uint8_t)v.m_BoneIDs[j] : 0;
+                p.m_Weights[j] = stored ? glm::packUnorm1x8(v.m_Weights[j]) : 0;
+            }
+        }
+        return packed;
+    }
+
+    // numbers the textures of each role (the N in texture_diffuseN) and puts the Nth texture of a role on its unit
+    // (textureroles.h); textures past the units of their role, or of no role, are not bound
+    void assignSamplers()
+    {
+        unsigned int number[TEXTURE_ROLE_COUNT] = {};
+        samplerSlots.clear();
+        samplerNames.clear();
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            TextureRole role = textureRole(textures[i].type);
+            textures[i].role = role;
+            if(role == TEXTURE_ROLE_COUNT || number[role] == TEXTURE_UNITS_PER_ROLE)
+                continue;
+            number[role]++;
+            SamplerSlot slot;
+            slot.unit = role * TEXTURE_UNITS_PER_ROLE + number[role] - 1;
+            slot.texture = textures[i].id;
+            samplerSlots.push_back(slot);
+            samplerNames.push_back(TEXTURE_ROLE_NAMES[role] + std::to_string(number[role]));
+        }
+    }
 
-    // initializes all the buffer objects/arrays
+    // points the program's samplers at the units; every mesh puts a sampler on the same unit, so the values never
+    // change once set and each mesh sets them the first time it draws with a program
+    void resolveSamplers(Shader &shader)
+    {
+        shader.use();
+        for(unsigned int i = 0; i < samplerSlots.size(); i++)
+            shader.setInt(shader.uniform<int>(samplerNames[i].c_str()), (int)samplerSlots[i].unit);
+        samplerShader = &shader;
+        samplerGeneration = shader.generation;
+    }
+
+    // uploads the vertices in the layout's format and the indices in the narrowest type into the arena
     void setupMesh()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);	
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);	
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);	
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-		// ids
-		glEnableVertexAttribArray(5);
-		glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-		// weights
-		glEnableVertexAttribArray(6);
-		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        glBindVertexArray(0);
+        vector<PackedVertex> packed;
+        const unsigned char *source = (const unsigned char*)vertices.data();
+        unsigned int sourceStride = sizeof(Vertex);
+        if(layout.format != VERTEX_FORMAT_FLOAT)
+        {
+            packed = packVertices();
+            source = (const unsigned char*)packed.data();
+            sourceStride = sizeof(PackedVertex);
+        }
+        GeometryDrawData data;
+        data.positionOffset = positionOffset;
+        data.positionScale = positionScale;
+        vertexCount = vertices.size();
+        indexCount = indices.size();
+        indexType = indexTypeFor(vertexCount);
+        if(indexType == GL_UNSIGNED_BYTE)
+            geometry = arena->add(layout, source, sourceStride, vertices.size(), narrowIndices<uint8_t>(indices).data(), indices.size(), data);
+        else if(indexType == GL_UNSIGNED_SHORT)
+            geometry = arena->add(layout, source, sourceStride, vertices.size(), narrowIndices<uint16_t>(indices).data(), indices.size() * sizeof(uint16_t), data);
+        else
+            geometry = arena->add(layout, source, sourceStride, vertices.size(), indices.data(), indices.size() * sizeof(unsigned int), data);
+        geometryGeneration = arena->generation;
+    }
+
+    // drops what the residency doesn't keep once the upload is done. The vectors are swapped with empty ones, as
+    // clear() would keep their storage
+    void applyResidency()
+    {
+        if(residency == MESH_KEEP_CPU_COPY)
+            return;
+        if(residency == MESH_KEEP_POSITIONS)
+        {
+            positions.resize(vertices.size());
+            for(unsigned int i = 0; i < vertices.size(); i++)
+                positions[i] = vertices[i].Position;
+        }
+        else
+            vector<unsigned int>().swap(indices);
+        vector<Vertex>().swap(vertices);
     }
 };
 #endif
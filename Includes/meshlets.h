@@ -0,0 +1,377 @@
+/*
+Meshlets: a mesh's triangles split into small clusters, each with a bounding sphere and a cone around its normals, so that the CPU can skip the clusters outside the frustum or facing away from the camera and draw the rest as a handful of index ranges. The per-frame culling splits the clusters across worker threads
+*/
+
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <frustum.h>
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+// the usual mesh shader limits; the index ranges drawn here have no hard limit, but clusters this small keep the
+// bounds tight
+const unsigned int MESHLET_MAX_VERTICES = 64;
+const unsigned int MESHLET_MAX_TRIANGLES = 124;
+
+// the meshlets of one mesh, one array per field like the culling batches. Meshlet i is the indices
+// [firstIndex[i], firstIndex[i] + indexCount[i]) of the mesh: the triangles are not reordered, so neighbouring
+// meshlets that both survive culling draw as one range
+struct MeshletSet
+{
+    SphereBatch bounds;
+    // the normalized mean of the triangle normals, and the cutoff of the cone test (the sine of the angle between
+    // the axis and the normal furthest from it). A cutoff of 1 means the normals spread too far for the meshlet to
+    // ever face away as a whole
+    std::vector<float> coneX, coneY, coneZ, coneCutoff;
+    std::vector<unsigned int> firstIndex, indexCount;
+
+    unsigned int size() const
+    {
+        return (unsigned int)firstIndex.size();
+    }
+    void clear()
+    {
+        bounds.clear();
+        coneX.clear(); coneY.clear(); coneZ.clear(); coneCutoff.clear();
+        firstIndex.clear(); indexCount.clear();
+    }
+};
+
+// what a cull did; the meshlets are either frustum culled, backface culled or drawn
+struct MeshletCullStats
+{
+    unsigned int meshlets = 0;
+    unsigned int frustumCulled = 0;
+    unsigned int backfaceCulled = 0;
+    unsigned int triangles = 0;
+    unsigned int trianglesDrawn = 0;
+    unsigned int ranges = 0; // index ranges left after merging neighbours, i.e. draws of the multi-draws
+    unsigned int calls = 0;  // multi-draw calls, one per mesh with anything left
+    double milliseconds = 0.0;
+
+    MeshletCullStats& operator+=(const MeshletCullStats &other)
+    {
+        meshlets += other.meshlets;
+        frustumCulled += other.frustumCulled;
+        backfaceCulled += other.backfaceCulled;
+        triangles += other.triangles;
+        trianglesDrawn += other.trianglesDrawn;
+        ranges += other.ranges;
+        calls += other.calls;
+        milliseconds += other.milliseconds;
+        return *this;
+    }
+};
+
+// unit normal of the triangle starting at index i, zero for a degenerate one
+template <typename V>
+glm::vec3 meshletTriangleNormal(const std::vector<unsigned int> &indices, const std::vector<V> &vertices, unsigned int i)
+{
+    const glm::vec3 &a = vertices[indices[i]].Position;
+    glm::vec3 n = glm::cross(vertices[indices[i + 1]].Position - a, vertices[indices[i + 2]].Position - a);
+    float length = glm::length(n);
+    return length > 0.0f ? n / length : glm::vec3(0.0f);
+}
+
+// sphere around the box of the meshlet's vertices, and the cone of its triangle normals
+template <typename V>
+void addMeshletBounds(MeshletSet &meshlets, const std::vector<unsigned int> &indices, const std::vector<V> &vertices, unsigned int first, unsigned int end)
+{
+    glm::vec3 min = vertices[indices[first]].Position, max = min;
+    for (unsigned int i = first + 1; i < end; i++)
+    {
+        min = glm::min(min, vertices[indices[i]].Position);
+        max = glm::max(max, vertices[indices[i]].Position);
+    }
+    glm::vec3 center = (min + max) * 0.5f;
+    float radius = 0.0f;
+    for (unsigned int i = first; i < end; i++)
+        radius = std::max(radius, glm::length(vertices[indices[i]].Position - center));
+
+    // counter-clockwise triangles, like GL's default front face; degenerate ones have no say
+    glm::vec3 sum(0.0f);
+    for (unsigned int i = first; i < end; i += 3)
+        sum += meshletTriangleNormal(indices, vertices, i);
+    glm::vec3 axis(0.0f, 0.0f, 1.0f);
+    float cutoff = 1.0f;
+    if (glm::length(sum) > 0.0f)
+    {
+        axis = glm::normalize(sum);
+        float minDot = 1.0f;
+        for (unsigned int i = first; i < end; i += 3)
+        {
+            glm::vec3 n = meshletTriangleNormal(indices, vertices, i);
+            if (n != glm::vec3(0.0f))
+                minDot = std::min(minDot, glm::dot(n, axis));
+        }
+        // past about 84 degrees the cone would cull almost nothing and loses precision
+        if (minDot > 0.1f)
+            cutoff = std::sqrt(1.0f - minDot * minDot);
+    }
+
+    meshlets.bounds.add(center, radius);
+    meshlets.coneX.push_back(axis.x);
+    meshlets.coneY.push_back(axis.y);
+    meshlets.coneZ.push_back(axis.z);
+    meshlets.coneCutoff.push_back(cutoff);
+    meshlets.firstIndex.push_back(first);
+    meshlets.indexCount.push_back(end - first);
+}
+
+// splits the first indexCount indices' triangles, in the order they are, into meshlets of at most maxVertices
+// distinct vertices and maxTriangles triangles. Run it after the vertex cache optimization (meshoptimize.h): that
+// order is already local, so consecutive triangles make compact clusters
+template <typename V>
+void buildMeshlets(MeshletSet &meshlets, const std::vector<unsigned int> &indices, size_t indexCount, const std::vector<V> &vertices, unsigned int maxVertices = MESHLET_MAX_VERTICES, unsigned int maxTriangles = MESHLET_MAX_TRIANGLES)
+{
+    meshlets.clear();
+    // the meshlet each vertex was last counted in
+    std::vector<unsigned int> usedBy(vertices.size(), 0xFFFFFFFFu);
+    unsigned int meshlet = 0, first = 0, vertexCount = 0;
+    for (unsigned int i = 0; i + 2 < indexCount; i += 3)
+    {
+        unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+        unsigned int added = (usedBy[a] != meshlet) + (usedBy[b] != meshlet && b != a) + (usedBy[c] != meshlet && c != a && c != b);
+        if (i > first && (vertexCount + added > maxVertices || (i - first) / 3 + 1 > maxTriangles))
+        {
+            addMeshletBounds(meshlets, indices, vertices, first, i);
+            meshlet++;
+            first = i;
+            vertexCount = 0;
+        }
+        for (unsigned int k = 0; k < 3; k++)
+            if (usedBy[indices[i + k]] != meshlet)
+            {
+                usedBy[indices[i + k]] = meshlet;
+                vertexCount++;
+            }
+    }
+    unsigned int end = (unsigned int)(indexCount - indexCount % 3);
+    if (end > first)
+        addMeshletBounds(meshlets, indices, vertices, first, end);
+}
+
+// culls meshlets against a frustum and the camera position, both in the mesh's local space, and leaves the
+// surviving index ranges in counts/offsets/baseVertices for one glMultiDrawElementsBaseVertex. The meshlets are
+// split into one part per thread: the calling thread takes the first, persistent workers the others
+class MeshletCuller
+{
+public:
+    // test the meshlets' cones: only right for meshes whose back faces are culled, or hidden because the mesh is
+    // closed
+    bool coneCulling = true;
+    // fewer meshlets than this per thread and the workers aren't woken, as waking them costs more than it saves
+    unsigned int minMeshletsPerThread = 256;
+
+    // the draw the last cull left, neighbouring meshlets merged into one range
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    std::vector<GLint> baseVertices;
+
+    // threads counts the calling thread, so 1 culls on the caller alone
+    explicit MeshletCuller(unsigned int threads = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        parts.resize(threads);
+        for (unsigned int i = 1; i < threads; i++)
+            workers.push_back(std::thread(&MeshletCuller::workerLoop, this, i));
+    }
+    ~MeshletCuller()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (unsigned int i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+    MeshletCuller(const MeshletCuller&) = delete;
+    MeshletCuller& operator=(const MeshletCuller&) = delete;
+
+    // the culler Model draws through unless it is given another one
+    static MeshletCuller& shared()
+    {
+        static MeshletCuller culler;
+        return culler;
+    }
+
+    unsigned int threadCount() const
+    {
+        return (unsigned int)parts.size();
+    }
+
+    // the ranges come out as byte offsets from indexOffset, for indices of indexSize bytes, all with baseVertex.
+    // cones is for the caller to turn the cone test off where the transform would invert it (a mirroring one)
+    const MeshletCullStats& cull(const MeshletSet &meshlets, const Frustum &localFrustum, const glm::vec3 &localCamera, bool cones, size_t indexOffset, unsigned int indexSize, GLint baseVertex)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        job.meshlets = &meshlets;
+        job.frustum = &localFrustum;
+        job.camera = localCamera;
+        job.cones = cones && coneCulling;
+
+        unsigned int count = meshlets.size();
+        unsigned int used = std::max(1u, std::min(threadCount(), count / std::max(1u, minMeshletsPerThread)));
+        unsigned int step = (count + used - 1) / used;
+        for (unsigned int i = 0; i < threadCount(); i++)
+        {
+            parts[i].first = std::min(count, i * step);
+            parts[i].end = i < used ? std::min(count, (i + 1) * step) : parts[i].first;
+        }
+        if (used > 1)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                generation++;
+                pending = (unsigned int)workers.size();
+            }
+            wake.notify_all();
+            cullPart(parts[0]);
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait(lock, [this] { return pending == 0; });
+        }
+        else
+            cullPart(parts[0]);
+
+        // the parts' ranges in order, joined where one part's last range runs into the next part's first
+        lastStats = MeshletCullStats();
+        counts.clear();
+        offsets.clear();
+        baseVertices.clear();
+        unsigned int runEnd = 0xFFFFFFFFu;
+        for (unsigned int i = 0; i < threadCount(); i++)
+        {
+            const Part &part = parts[i];
+            lastStats += part.stats;
+            for (unsigned int r = 0; r < part.rangeFirst.size(); r++)
+            {
+                if (part.rangeFirst[r] == runEnd)
+                    counts.back() += (GLsizei)part.rangeCount[r];
+                else
+                {
+                    counts.push_back((GLsizei)part.rangeCount[r]);
+                    offsets.push_back((const void*)(indexOffset + (size_t)part.rangeFirst[r] * indexSize));
+                    baseVertices.push_back(baseVertex);
+                }
+                runEnd = part.rangeFirst[r] + part.rangeCount[r];
+            }
+        }
+        lastStats.ranges = (unsigned int)counts.size();
+        lastStats.calls = counts.empty() ? 0 : 1;
+        lastStats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return lastStats;
+    }
+
+    // what the last cull did
+    const MeshletCullStats& stats() const
+    {
+        return lastStats;
+    }
+
+private:
+    // a slice of the meshlets and what came of it; written by one thread only
+    struct Part
+    {
+        unsigned int first = 0, end = 0;
+        std::vector<std::uint64_t> visible;
+        std::vector<unsigned int> rangeFirst, rangeCount;
+        MeshletCullStats stats;
+    };
+    // the cull in flight, read by every part
+    struct Job
+    {
+        const MeshletSet *meshlets = NULL;
+        const Frustum *frustum = NULL;
+        glm::vec3 camera;
+        bool cones = true;
+    };
+    Job job;
+    std::vector<Part> parts;
+    MeshletCullStats lastStats;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    unsigned int generation = 0;
+    unsigned int pending = 0;
+    bool stopping = false;
+
+    void workerLoop(unsigned int index)
+    {
+        unsigned int seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            cullPart(parts[index]);
+            bool last;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                last = --pending == 0;
+            }
+            if (last)
+                done.notify_one();
+        }
+    }
+
+    void cullPart(Part &part)
+    {
+        const MeshletSet &meshlets = *job.meshlets;
+        part.stats = MeshletCullStats();
+        part.rangeFirst.clear();
+        part.rangeCount.clear();
+        if (part.end <= part.first)
+            return;
+        job.frustum->cull(meshlets.bounds, part.first, part.end - part.first, part.visible);
+        for (unsigned int i = part.first; i < part.end; i++)
+        {
+            unsigned int triangles = meshlets.indexCount[i] / 3;
+            part.stats.meshlets++;
+            part.stats.triangles += triangles;
+            if (!isVisible(part.visible, i - part.first))
+            {
+                part.stats.frustumCulled++;
+                continue;
+            }
+            // every triangle faces away when the camera sits inside the cone opposite the normals, widened by the
+            // bounding sphere
+            if (job.cones)
+            {
+                glm::vec3 toCenter = glm::vec3(meshlets.bounds.centerX[i], meshlets.bounds.centerY[i], meshlets.bounds.centerZ[i]) - job.camera;
+                glm::vec3 axis(meshlets.coneX[i], meshlets.coneY[i], meshlets.coneZ[i]);
+                if (glm::dot(toCenter, axis) >= meshlets.coneCutoff[i] * glm::length(toCenter) + meshlets.bounds.radius[i])
+                {
+                    part.stats.backfaceCulled++;
+                    continue;
+                }
+            }
+            part.stats.trianglesDrawn += triangles;
+            if (!part.rangeFirst.empty() && part.rangeFirst.back() + part.rangeCount.back() == meshlets.firstIndex[i])
+                part.rangeCount.back() += meshlets.indexCount[i];
+            else
+            {
+                part.rangeFirst.push_back(meshlets.firstIndex[i]);
+                part.rangeCount.push_back(meshlets.indexCount[i]);
+            }
+        }
+    }
+};
+#endif
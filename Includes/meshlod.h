@@ -0,0 +1,510 @@
+/*
+Level-of-detail chains: load-time simplification by edge collapses ordered by quadric error (Garland-Heckbert), with each level's geometric error recorded, and the per-draw choice of the coarsest level whose error projects to under a pixel or so on screen. The levels share the mesh's vertices and differ only in their indices
+*/
+
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <glm/glm.hpp>
+
+#include <meshoptimize.h>
+
+#include <vector>
+#include <map>
+#include <queue>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <tuple>
+
+// no more levels than this, and none with fewer triangles than LOD_MIN_TRIANGLES
+const unsigned int MAX_LOD_LEVELS = 8;
+const unsigned int LOD_MIN_TRIANGLES = 64;
+
+// one level: a slice of the mesh's index buffer, and how far its surface may be from the full-detail one, in the
+// mesh's local units
+struct MeshLod
+{
+    unsigned int firstIndex = 0;
+    unsigned int indexCount = 0;
+    float error = 0.0f;
+};
+
+// closest distance from p to the triangle abc (Ericson, Real-Time Collision Detection 5.1.5)
+inline float pointTriangleDistance(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+{
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return glm::length(p - a);
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return glm::length(p - b);
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return glm::length(p - (a + ab * (d1 / (d1 - d3))));
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return glm::length(p - c);
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return glm::length(p - (a + ac * (d2 / (d2 - d6))));
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+        return glm::length(p - (b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))));
+    float denominator = 1.0f / (va + vb + vc);
+    return glm::length(p - (a + ab * (vb * denominator) + ac * (vc * denominator)));
+}
+
+// sum of squared distances to a set of planes, weighted by the area of the triangles they came from
+struct Quadric
+{
+    double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+    double b0 = 0, b1 = 0, b2 = 0, c = 0;
+    double weight = 0;
+
+    static Quadric plane(const glm::dvec3 &n, double d, double weight)
+    {
+        Quadric q;
+        q.a00 = n.x * n.x * weight; q.a01 = n.x * n.y * weight; q.a02 = n.x * n.z * weight;
+        q.a11 = n.y * n.y * weight; q.a12 = n.y * n.z * weight; q.a22 = n.z * n.z * weight;
+        q.b0 = n.x * d * weight; q.b1 = n.y * d * weight; q.b2 = n.z * d * weight;
+        q.c = d * d * weight;
+        q.weight = weight;
+        return q;
+    }
+    Quadric& operator+=(const Quadric &o)
+    {
+        a00 += o.a00; a01 += o.a01; a02 += o.a02; a11 += o.a11; a12 += o.a12; a22 += o.a22;
+        b0 += o.b0; b1 += o.b1; b2 += o.b2; c += o.c;
+        weight += o.weight;
+        return *this;
+    }
+    // mean squared distance of p to the planes, so its square root is a distance in the mesh's units
+    double error(const glm::vec3 &p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double e = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                 + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+        return weight > 0.0 ? std::max(0.0, e) / weight : 0.0;
+    }
+};
+
+// Collapses edges onto one of their endpoints, cheapest first, so no new vertices are made and every level indexes
+// the original vertex buffer. Vertices with the same position (UV and normal seams) are collapsed together, each
+// copy onto the copy of the other endpoint on its own side of the seam, so seams neither crack nor smear
+// attributes across; a collapse with no such pairing is skipped, as is one that would flip a triangle. Vertices
+// on an open border only move along it
+template <typename V>
+class MeshSimplifier
+{
+public:
+    MeshSimplifier(const std::vector<unsigned int> &indices, const std::vector<V> &vertices) : vertices(vertices)
+    {
+        // one id per distinct position
+        std::map<std::tuple<float, float, float>, unsigned int> positions;
+        weld.resize(vertices.size());
+        for (unsigned int i = 0; i < vertices.size(); i++)
+        {
+            const glm::vec3 &p = vertices[i].Position;
+            std::tuple<float, float, float> key(p.x, p.y, p.z);
+            std::map<std::tuple<float, float, float>, unsigned int>::iterator found = positions.find(key);
+            if (found == positions.end())
+            {
+                found = positions.insert(std::make_pair(key, (unsigned int)welded.size())).first;
+                welded.push_back(WeldedVertex());
+                welded.back().position = p;
+            }
+            weld[i] = found->second;
+        }
+
+        for (unsigned int i = 0; i + 2 < indices.size(); i += 3)
+        {
+            Triangle t = { { indices[i], indices[i + 1], indices[i + 2] } };
+            if (weld[t.v[0]] == weld[t.v[1]] || weld[t.v[1]] == weld[t.v[2]] || weld[t.v[0]] == weld[t.v[2]])
+                continue;
+            unsigned int id = (unsigned int)triangles.size();
+            triangles.push_back(t);
+            for (unsigned int k = 0; k < 3; k++)
+                welded[weld[t.v[k]]].triangles.push_back(id);
+        }
+        alive = (unsigned int)triangles.size();
+        // the corners and the triangles around each vertex as they were, for surfaceError()
+        originalAroundStart.assign(welded.size() + 1, 0);
+        for (unsigned int t = 0; t < triangles.size(); t++)
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                originalCorners.push_back(weld[triangles[t].v[k]]);
+                originalAroundStart[weld[triangles[t].v[k]] + 1]++;
+            }
+        for (unsigned int w = 0; w < welded.size(); w++)
+            originalAroundStart[w + 1] += originalAroundStart[w];
+        originalAround.resize(originalCorners.size());
+        std::vector<unsigned int> filled(originalAroundStart.begin(), originalAroundStart.end() - 1);
+        for (unsigned int i = 0; i < originalCorners.size(); i++)
+            originalAround[filled[originalCorners[i]]++] = i / 3;
+
+        // every triangle's plane goes into the quadrics of its corners
+        for (unsigned int t = 0; t < triangles.size(); t++)
+        {
+            glm::dvec3 a = position(t, 0), b = position(t, 1), c = position(t, 2);
+            glm::dvec3 n = glm::cross(b - a, c - a);
+            double area = glm::length(n);
+            if (area <= 0.0)
+                continue;
+            n /= area;
+            Quadric q = Quadric::plane(n, -glm::dot(n, a), area * 0.5);
+            for (unsigned int k = 0; k < 3; k++)
+                welded[weld[triangles[t].v[k]]].quadric += q;
+        }
+        // open edges add a plane through them, square to the triangle, so the border keeps its shape
+        for (unsigned int t = 0; t < triangles.size(); t++)
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                unsigned int from = weld[triangles[t].v[k]], to = weld[triangles[t].v[(k + 1) % 3]];
+                if (sharedTriangles(from, to) != 1)
+                    continue;
+                welded[from].border = welded[to].border = true;
+                glm::dvec3 a(welded[from].position), b(welded[to].position), c = position(t, (k + 2) % 3);
+                glm::dvec3 normal = glm::cross(b - a, c - a);
+                glm::dvec3 edge = b - a;
+                double length = glm::length(edge);
+                if (length <= 0.0 || glm::length(normal) <= 0.0)
+                    continue;
+                glm::dvec3 n = glm::normalize(glm::cross(edge, normal));
+                Quadric q = Quadric::plane(n, -glm::dot(n, a), length * length);
+                welded[from].quadric += q;
+                welded[to].quadric += q;
+            }
+
+        for (unsigned int t = 0; t < triangles.size(); t++)
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                unsigned int a = weld[triangles[t].v[k]], b = weld[triangles[t].v[(k + 1) % 3]];
+                push(a, b);
+                push(b, a);
+            }
+    }
+
+    unsigned int triangleCount() const
+    {
+        return alive;
+    }
+    // the largest quadric error of any collapse so far: the root mean square distance to the planes the moved
+    // vertex gathered, which is what orders the collapses but averages a flattened fin away with its body
+    float quadricError() const
+    {
+        return (float)std::sqrt(maxError);
+    }
+    // how far the surface moved, as the largest distance from an original position to the triangles around the
+    // vertices it and its original neighbours were collapsed into. The closest triangle can be further away, so this
+    // errs on the large side, which is the safe side for picking levels
+    float surfaceError()
+    {
+        float error = 0.0f;
+        for (unsigned int w = 0; w < welded.size(); w++)
+        {
+            if (!welded[w].removed)
+                continue;
+            // neighbours mostly share where they went, so each place is searched once
+            nearby.clear();
+            for (unsigned int i = originalAroundStart[w]; i < originalAroundStart[w + 1]; i++)
+                for (unsigned int k = 0; k < 3; k++)
+                {
+                    unsigned int into = representative(originalCorners[originalAround[i] * 3 + k]);
+                    if (std::find(nearby.begin(), nearby.end(), into) == nearby.end())
+                        nearby.push_back(into);
+                }
+            float closest = 3.4e38f;
+            bool found = false;
+            for (unsigned int i = 0; i < nearby.size(); i++)
+            {
+                const std::vector<unsigned int> &around = welded[nearby[i]].triangles;
+                for (unsigned int j = 0; j < around.size(); j++)
+                {
+                    const Triangle &t = triangles[around[j]];
+                    if (t.removed)
+                        continue;
+                    closest = std::min(closest, pointTriangleDistance(welded[w].position, welded[weld[t.v[0]]].position, welded[weld[t.v[1]]].position, welded[weld[t.v[2]]].position));
+                    found = true;
+                }
+            }
+            if (found)
+                error = std::max(error, closest);
+        }
+        return error;
+    }
+
+    // collapses edges until at most targetTriangles are left; returns false once no edge can be collapsed
+    bool simplify(unsigned int targetTriangles)
+    {
+        while (alive > targetTriangles)
+        {
+            if (queue.empty())
+                return false;
+            Candidate candidate = queue.top();
+            queue.pop();
+            WeldedVertex &from = welded[candidate.from];
+            WeldedVertex &to = welded[candidate.to];
+            if (from.removed || to.removed || from.version != candidate.fromVersion || to.version != candidate.toVersion)
+                continue;
+            if (!collapse(candidate.from, candidate.to))
+                continue;
+            maxError = std::max(maxError, candidate.cost);
+        }
+        return true;
+    }
+
+    // the triangles left, as indices into the original vertices
+    void appendIndices(std::vector<unsigned int> &indices) const
+    {
+        for (unsigned int t = 0; t < triangles.size(); t++)
+            if (!triangles[t].removed)
+                indices.insert(indices.end(), triangles[t].v, triangles[t].v + 3);
+    }
+
+private:
+    struct Triangle
+    {
+        unsigned int v[3];
+        bool removed = false;
+    };
+    struct WeldedVertex
+    {
+        glm::vec3 position;
+        Quadric quadric;
+        std::vector<unsigned int> triangles;
+        unsigned int version = 0;
+        bool border = false;
+        bool removed = false;
+        unsigned int collapsedInto = ~0u;
+    };
+    // moving from onto to costs cost; stale once either end changed since
+    struct Candidate
+    {
+        double cost;
+        unsigned int from, to;
+        unsigned int fromVersion, toVersion;
+        bool operator<(const Candidate &o) const
+        {
+            return cost > o.cost;
+        }
+    };
+
+    const std::vector<V> &vertices;
+    std::vector<unsigned int> weld;
+    std::vector<WeldedVertex> welded;
+    std::vector<Triangle> triangles;
+    unsigned int alive = 0;
+    std::vector<unsigned int> originalCorners;
+    std::vector<unsigned int> originalAroundStart, originalAround;
+    std::priority_queue<Candidate> queue;
+    double maxError = 0.0;
+    // scratch space for collapse() and surfaceError()
+    std::vector<std::pair<unsigned int, unsigned int> > pairs;
+    std::vector<unsigned int> nearby;
+
+    // the vertex w ended up in, after every collapse; the chain is shortened on the way
+    unsigned int representative(unsigned int w)
+    {
+        unsigned int into = w;
+        while (welded[into].removed)
+            into = welded[into].collapsedInto;
+        while (welded[w].removed && welded[w].collapsedInto != into)
+        {
+            unsigned int next = welded[w].collapsedInto;
+            welded[w].collapsedInto = into;
+            w = next;
+        }
+        return into;
+    }
+
+    glm::dvec3 position(unsigned int t, unsigned int k) const
+    {
+        return glm::dvec3(welded[weld[triangles[t].v[k]]].position);
+    }
+
+    unsigned int sharedTriangles(unsigned int a, unsigned int b) const
+    {
+        unsigned int count = 0;
+        const std::vector<unsigned int> &around = welded[a].triangles;
+        for (unsigned int i = 0; i < around.size(); i++)
+        {
+            const Triangle &t = triangles[around[i]];
+            if (!t.removed && (weld[t.v[0]] == b || weld[t.v[1]] == b || weld[t.v[2]] == b))
+                count++;
+        }
+        return count;
+    }
+
+    void push(unsigned int from, unsigned int to)
+    {
+        Quadric q = welded[from].quadric;
+        q += welded[to].quadric;
+        Candidate candidate = { q.error(welded[to].position), from, to, welded[from].version, welded[to].version };
+        queue.push(candidate);
+    }
+
+    bool collapse(unsigned int from, unsigned int to)
+    {
+        WeldedVertex &source = welded[from];
+        WeldedVertex &target = welded[to];
+        // a border vertex only slides along the border
+        if (source.border && sharedTriangles(from, to) != 1)
+            return false;
+
+        // every copy of the moving vertex needs exactly one copy of the target it shares a triangle with
+        pairs.clear();
+        for (unsigned int i = 0; i < source.triangles.size(); i++)
+        {
+            const Triangle &t = triangles[source.triangles[i]];
+            if (t.removed)
+                continue;
+            unsigned int own = 0, other = ~0u;
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                if (weld[t.v[k]] == from)
+                    own = t.v[k];
+                else if (weld[t.v[k]] == to)
+                    other = t.v[k];
+            }
+            bool known = false;
+            for (unsigned int p = 0; p < pairs.size(); p++)
+                if (pairs[p].first == own)
+                {
+                    if (other != ~0u && pairs[p].second != ~0u && pairs[p].second != other)
+                        return false;
+                    if (other != ~0u)
+                        pairs[p].second = other;
+                    known = true;
+                }
+            if (!known)
+                pairs.push_back(std::make_pair(own, other));
+        }
+        for (unsigned int p = 0; p < pairs.size(); p++)
+            if (pairs[p].second == ~0u)
+                return false;
+
+        // the triangles that stay must not turn over
+        for (unsigned int i = 0; i < source.triangles.size(); i++)
+        {
+            const Triangle &t = triangles[source.triangles[i]];
+            if (t.removed || weld[t.v[0]] == to || weld[t.v[1]] == to || weld[t.v[2]] == to)
+                continue;
+            glm::vec3 p[3], moved[3];
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                p[k] = welded[weld[t.v[k]]].position;
+                moved[k] = weld[t.v[k]] == from ? target.position : p[k];
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+            if (glm::dot(before, after) <= 0.0f)
+                return false;
+        }
+
+        for (unsigned int i = 0; i < source.triangles.size(); i++)
+        {
+            unsigned int id = source.triangles[i];
+            Triangle &t = triangles[id];
+            if (t.removed)
+                continue;
+            if (weld[t.v[0]] == to || weld[t.v[1]] == to || weld[t.v[2]] == to)
+            {
+                t.removed = true;
+                alive--;
+                continue;
+            }
+            for (unsigned int k = 0; k < 3; k++)
+                if (weld[t.v[k]] == from)
+                    for (unsigned int p = 0; p < pairs.size(); p++)
+                        if (pairs[p].first == t.v[k])
+                            t.v[k] = pairs[p].second;
+            target.triangles.push_back(id);
+        }
+        target.quadric += source.quadric;
+        target.border = target.border || source.border;
+        target.version++;
+        source.removed = true;
+        source.collapsedInto = to;
+        source.triangles.clear();
+
+        // the target's costs changed, both ways; its removed triangles are dropped from its list on the way
+        std::vector<unsigned int> &around = target.triangles;
+        unsigned int kept = 0;
+        for (unsigned int i = 0; i < around.size(); i++)
+        {
+            const Triangle &t = triangles[around[i]];
+            if (t.removed)
+                continue;
+            around[kept++] = around[i];
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                unsigned int other = weld[t.v[k]];
+                if (other != to)
+                {
+                    push(to, other);
+                    push(other, to);
+                }
+            }
+        }
+        around.resize(kept);
+        return true;
+    }
+};
+
+// simplifies the mesh's indices into a chain of levels, each with about half the triangles of the one before, and
+// appends their indices (reordered for the vertex cache) after the full-detail ones. Returns every level, the
+// full-detail one first; the chain stops early once simplification can't halve the triangles any more
+template <typename V>
+std::vector<MeshLod> buildLodChain(std::vector<unsigned int> &indices, const std::vector<V> &vertices, float ratio = 0.5f, unsigned int maxLevels = MAX_LOD_LEVELS)
+{
+    std::vector<MeshLod> lods(1);
+    lods[0].indexCount = (unsigned int)indices.size();
+    MeshSimplifier<V> simplifier(indices, vertices);
+    unsigned int triangles = (unsigned int)(indices.size() / 3);
+    std::vector<unsigned int> level;
+    while (lods.size() < maxLevels)
+    {
+        unsigned int target = (unsigned int)(triangles * ratio);
+        if (target < LOD_MIN_TRIANGLES)
+            break;
+        simplifier.simplify(target);
+        // a level that barely shrank isn't worth its indices
+        if (simplifier.triangleCount() > triangles * (1.0f + ratio) * 0.5f)
+            break;
+        triangles = simplifier.triangleCount();
+        level.clear();
+        simplifier.appendIndices(level);
+        optimizeVertexCache(level, vertices.size());
+        MeshLod lod;
+        lod.firstIndex = (unsigned int)indices.size();
+        lod.indexCount = (unsigned int)level.size();
+        lod.error = std::max(lods.back().error, simplifier.surfaceError());
+        lods.push_back(lod);
+        indices.insert(indices.end(), level.begin(), level.end());
+    }
+    return lods;
+}
+
+// pixels one unit of error covers at distance 1, for a vertical field of view of zoomDegrees (Camera::Zoom) over
+// viewportHeight pixels
+inline float lodProjectionScale(float zoomDegrees, float viewportHeight)
+{
+    return viewportHeight / (2.0f * std::tan(glm::radians(zoomDegrees) * 0.5f));
+}
+
+// the coarsest level whose error, scaled by errorScale (the largest scale of the model matrix) and seen from
+// distance, covers at most pixelThreshold pixels
+inline unsigned int selectLod(const std::vector<MeshLod> &lods, float errorScale, float distance, float projectionScale, float pixelThreshold = 1.0f)
+{
+    unsigned int level = 0;
+    float pixelsPerUnit = projectionScale / std::max(distance, 1e-4f);
+    for (unsigned int i = 1; i < lods.size(); i++)
+        if (lods[i].error * errorScale * pixelsPerUnit <= pixelThreshold)
+            level = i;
+    return level;
+}
+#endif
@@ -0,0 +1,273 @@
+/*
+Load-time reordering of index and vertex buffers: triangles for the post-transform vertex cache (Forsyth's linear-speed algorithm), clusters of them so outward-facing ones come first and hide what's behind, and vertices in the order the triangles first use them
+*/
+
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// the cache size the analysis simulates; a FIFO of 16 is the conservative end of real hardware
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+// how often vertices go through the vertex shader when the indices are drawn
+struct VertexCacheStats
+{
+    unsigned int triangles = 0;
+    unsigned int vertices = 0;    // distinct vertices referenced
+    unsigned int transformed = 0; // cache misses
+    // average cache miss ratio: transformed vertices per triangle, 0.5 at best for big regular meshes, 3 at worst
+    float acmr() const
+    {
+        return triangles ? (float)transformed / triangles : 0.0f;
+    }
+    // average transform to vertex ratio: 1 means every vertex was shaded once
+    float atvr() const
+    {
+        return vertices ? (float)transformed / vertices : 0.0f;
+    }
+    VertexCacheStats& operator+=(const VertexCacheStats &other)
+    {
+        triangles += other.triangles;
+        vertices += other.vertices;
+        transformed += other.transformed;
+        return *this;
+    }
+};
+
+// runs the indices through a FIFO cache of cacheSize entries
+inline VertexCacheStats analyzeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+    VertexCacheStats stats;
+    stats.triangles = (unsigned int)(indices.size() / 3);
+    // a vertex is still cached while fewer than cacheSize misses happened since its own
+    std::vector<unsigned int> missedAt(vertexCount, 0);
+    std::vector<bool> seen(vertexCount, false);
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        unsigned int v = indices[i];
+        if (!seen[v])
+        {
+            seen[v] = true;
+            stats.vertices++;
+        }
+        else if (stats.transformed - missedAt[v] < cacheSize)
+            continue;
+        missedAt[v] = stats.transformed;
+        stats.transformed++;
+    }
+    return stats;
+}
+
+// Forsyth's scoring: vertices in the modelled LRU cache score by how recently they were used, the three of the
+// last triangle a little less so the strip doesn't double back, and vertices with few triangles left get a boost
+// so they're finished off instead of stranded
+const int FORSYTH_CACHE_SIZE = 32;
+
+inline float forsythVertexScore(int cachePosition, unsigned int remainingTriangles)
+{
+    if (remainingTriangles == 0)
+        return -1.0f;
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+        if (cachePosition < 3)
+            score = 0.75f;
+        else
+            score = std::pow(1.0f - (float)(cachePosition - 3) / (FORSYTH_CACHE_SIZE - 3), 1.5f);
+    }
+    return score + 2.0f / std::sqrt((float)remainingTriangles);
+}
+
+// reorders the triangles so consecutive ones share vertices while they're still in the cache
+inline void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    //a) triangles of each vertex, as offsets into one array
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        remaining[indices[i]]++;
+    std::vector<unsigned int> firstTriangle(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+    std::vector<unsigned int> vertexTriangles(triangleCount * 3);
+    std::vector<unsigned int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+        for (unsigned int c = 0; c < 3; c++)
+            vertexTriangles[filled[indices[t * 3 + c]]++] = (unsigned int)t;
+
+    //b) initial scores
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        vertexScore[v] = forsythVertexScore(-1, remaining[v]);
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+    //c) emit the best triangle, update the cache, rescore what it touched
+    std::vector<unsigned int> output;
+    output.reserve(triangleCount * 3);
+    std::vector<unsigned int> cache, nextCache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    nextCache.reserve(FORSYTH_CACHE_SIZE + 3);
+    size_t best = 0;
+    size_t scanFrom = 0;
+    for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+    {
+        emitted[best] = true;
+        const unsigned int *triangle = &indices[best * 3];
+        nextCache.assign(triangle, triangle + 3);
+        for (unsigned int c = 0; c < 3; c++)
+        {
+            unsigned int v = triangle[c];
+            output.push_back(v);
+            // take the triangle off the vertex's list
+            unsigned int *begin = &vertexTriangles[firstTriangle[v]];
+            unsigned int *end = begin + remaining[v];
+            *std::find(begin, end, (unsigned int)best) = *(end - 1);
+            remaining[v]--;
+        }
+        for (size_t i = 0; i < cache.size(); i++)
+            if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2])
+                nextCache.push_back(cache[i]);
+        cache.swap(nextCache);
+        // vertices pushed past the end leave the cache and lose their position score
+        for (size_t i = 0; i < cache.size(); i++)
+        {
+            cachePosition[cache[i]] = i < (size_t)FORSYTH_CACHE_SIZE ? (int)i : -1;
+            vertexScore[cache[i]] = forsythVertexScore(cachePosition[cache[i]], remaining[cache[i]]);
+        }
+        // the next triangle is the best one among those of cached vertices
+        float bestScore = -1.0f;
+        for (size_t i = 0; i < cache.size(); i++)
+        {
+            unsigned int v = cache[i];
+            for (unsigned int k = 0; k < remaining[v]; k++)
+            {
+                unsigned int t = vertexTriangles[firstTriangle[v] + k];
+                triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                if (triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+        if (cache.size() > (size_t)FORSYTH_CACHE_SIZE)
+            cache.resize(FORSYTH_CACHE_SIZE);
+        // nothing left around the cache: continue with the next triangle not emitted yet, in the original order
+        if (bestScore < 0.0f)
+        {
+            while (scanFrom < triangleCount && emitted[scanFrom])
+                scanFrom++;
+            best = scanFrom;
+        }
+    }
+    indices.swap(output);
+}
+
+// splits cache-ordered triangles into clusters where the cache starts over, and sorts the clusters so those
+// facing away from the mesh's center (the ones likely in front from any view) are drawn first. If that costs
+// more than threshold times the cache misses of the input order, the input order is kept
+template <typename V>
+void optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<V> &vertices, float threshold = 1.05f)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    //a) a cluster starts at each triangle whose vertices all miss the cache
+    std::vector<size_t> clusterStart;
+    std::vector<unsigned int> missedAt(vertices.size(), 0);
+    std::vector<bool> seen(vertices.size(), false);
+    unsigned int misses = 0;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        unsigned int triangleMisses = 0;
+        for (unsigned int c = 0; c < 3; c++)
+        {
+            unsigned int v = indices[t * 3 + c];
+            if (seen[v] && misses - missedAt[v] < VERTEX_CACHE_SIZE)
+                continue;
+            seen[v] = true;
+            missedAt[v] = misses++;
+            triangleMisses++;
+        }
+        if (t == 0 || triangleMisses == 3)
+            clusterStart.push_back(t);
+    }
+    clusterStart.push_back(triangleCount);
+
+    //b) mesh centroid, then each cluster's area-weighted centroid and normal
+    glm::vec3 meshCenter(0.0f);
+    for (size_t i = 0; i < indices.size(); i++)
+        meshCenter += vertices[indices[i]].Position;
+    meshCenter /= (float)indices.size();
+    size_t clusterCount = clusterStart.size() - 1;
+    std::vector<float> sortKey(clusterCount);
+    for (size_t k = 0; k < clusterCount; k++)
+    {
+        glm::vec3 center(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusterStart[k]; t < clusterStart[k + 1]; t++)
+        {
+            glm::vec3 a = vertices[indices[t * 3]].Position;
+            glm::vec3 b = vertices[indices[t * 3 + 1]].Position;
+            glm::vec3 c = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 n = glm::cross(b - a, c - a);
+            float triangleArea = glm::length(n);
+            center += (a + b + c) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+        if (area > 0.0f)
+            center /= area;
+        float length = glm::length(normal);
+        sortKey[k] = length > 0.0f ? glm::dot(center - meshCenter, normal / length) : 0.0f;
+    }
+
+    //c) outward-facing clusters first
+    std::vector<size_t> order(clusterCount);
+    for (size_t k = 0; k < clusterCount; k++)
+        order[k] = k;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+    std::vector<unsigned int> sorted;
+    sorted.reserve(indices.size());
+    for (size_t k = 0; k < clusterCount; k++)
+        sorted.insert(sorted.end(), indices.begin() + clusterStart[order[k]] * 3, indices.begin() + clusterStart[order[k] + 1] * 3);
+
+    if (analyzeVertexCache(sorted, vertices.size()).transformed <= threshold * analyzeVertexCache(indices, vertices.size()).transformed)
+        indices.swap(sorted);
+}
+
+// renumbers the vertices in the order the indices first use them, so the vertex fetch walks the buffer forward;
+// vertices no triangle uses are dropped
+template <typename V>
+void optimizeVertexFetch(std::vector<V> &vertices, std::vector<unsigned int> &indices)
+{
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), unused);
+    std::vector<V> reordered;
+    reordered.reserve(vertices.size());
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        unsigned int &to = remap[indices[i]];
+        if (to == unused)
+        {
+            to = (unsigned int)reordered.size();
+            reordered.push_back(vertices[indices[i]]);
+        }
+        indices[i] = to;
+    }
+    vertices.swap(reordered);
+}
+#endif
@@ -11,7 +11,11 @@
 #include <assimp/postprocess.h>
 
 #include <mesh.h>
+#include <drawbatch.h>
 #include <shaders.h>
+#include <glstate.h>
+#include <frustum.h>
+#include <meshoptimize.h>
 
 #include <string>
 #include <fstream>
@@ -19,8 +23,21 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <utility>
 using namespace std;
 
+// load-time reordering of each mesh's buffers (see meshoptimize.h), and the simplified levels of detail
+// (meshlod.h), which are left out of MESH_OPTIMIZE_ALL as they cost more load time than the rest together
+enum MeshOptimization
+{
+    MESH_OPTIMIZE_NONE         = 0,
+    MESH_OPTIMIZE_VERTEX_CACHE = 1 << 0,
+    MESH_OPTIMIZE_OVERDRAW     = 1 << 1,
+    MESH_OPTIMIZE_VERTEX_FETCH = 1 << 2,
+    MESH_OPTIMIZE_ALL          = (1 << 3) - 1,
+    MESH_GENERATE_LODS         = 1 << 3
+};
+
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
 class Model 
@@ -31,27 +48,214 @@ public:
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    // how every mesh's vertices are uploaded; each mesh drops the attributes its data doesn't have
+    VertexLayout vertexLayout;
+    // MeshOptimization bits applied to every mesh, and the vertex cache behaviour before and after, over all meshes
+    unsigned int optimizations;
+    VertexCacheStats cacheBefore, cacheAfter;
+    // what every mesh keeps in RAM after its upload
+    MeshResidency residency;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const &path, bool gamma = false, VertexLayout layout = VertexLayout(), unsigned int optimize = MESH_OPTIMIZE_ALL, MeshResidency residency = MESH_KEEP_CPU_COPY) : gammaCorrection(gamma), vertexLayout(layout), optimizations(optimize), residency(residency)
     {
         loadModel(path);
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader &shader)
+    // union of the shader features its meshes need
+    unsigned int features() const
+    {
+        unsigned int mask = 0;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            mask |= meshes[i].features();
+        return mask;
+    }
+
+    // draws the model, and thus all its meshes, as one multi-draw per group of meshes with the same textures. Every
+    // draw here uses each mesh's current level of detail, full detail unless SelectLods picked another
+    const DrawBatchStats& Draw(Shader &shader, DrawBatch &batch = DrawBatch::shared())
+    {
+        batch.clear();
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            batch.add(meshes[i]);
+        return batch.submit(shader);
+    }
+
+    // draws one copy of the model per transform: the transforms are uploaded once, then every mesh is one instanced
+    // draw. The program must be built with INSTANCED (SHADER_INSTANCED), which takes the model matrix per instance
+    void DrawInstanced(Shader &shader, const glm::mat4 *transforms, size_t count)
+    {
+        GeometryArena *uploaded = NULL;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            if(meshes[i].arena != uploaded)
+            {
+                meshes[i].arena->instances.upload(transforms, count);
+                uploaded = meshes[i].arena;
+            }
+            meshes[i].DrawInstanced(shader, (GLsizei)count);
+        }
+    }
+    void DrawInstanced(Shader &shader, const vector<glm::mat4> &transforms)
+    {
+        DrawInstanced(shader, transforms.data(), transforms.size());
+    }
+
+    // draws positions only, for depth and shadow passes
+    const DrawBatchStats& DrawDepth(Shader &shader, DrawBatch &batch = DrawBatch::shared())
+    {
+        batch.clear();
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            batch.add(meshes[i]);
+        return batch.submitDepth(shader);
+    }
+
+    // GPU bytes of all vertex buffers, as uploaded and as they would be in another format
+    size_t vertexBufferBytes() const
+    {
+        size_t bytes = 0;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            bytes += meshes[i].vertexBufferBytes();
+        return bytes;
+    }
+    size_t vertexBufferBytes(VertexFormat format, unsigned int attributes = VERTEX_ALL_ATTRIBUTES) const
+    {
+        size_t bytes = 0;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            bytes += meshes[i].vertexCount * vertexStride(format, attributes);
+        return bytes;
+    }
+    // GPU bytes of all index buffers
+    size_t indexBufferBytes() const
+    {
+        size_t bytes = 0;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            bytes += meshes[i].indexBufferBytes();
+        return bytes;
+    }
+    // RAM the meshes' CPU copies take, after the residency dropped what it doesn't keep
+    size_t cpuGeometryBytes() const
+    {
+        size_t bytes = 0;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            bytes += meshes[i].cpuGeometryBytes();
+        return bytes;
+    }
+
+    // draws only the meshes whose bounds, placed with the model matrix, touch the frustum; returns how many
+    // were drawn (batch.stats() has the calls it took)
+    unsigned int Draw(Shader &shader, const Frustum &frustum, const glm::mat4 &model, DrawBatch &batch = DrawBatch::shared())
+    {
+        cullBounds.clear();
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            cullBounds.add(meshes[i].boundsMin, meshes[i].boundsMax, model);
+        unsigned int drawn = frustum.cull(cullBounds, cullVisible);
+        batch.clear();
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            if(isVisible(cullVisible, i))
+                batch.add(meshes[i]);
+        batch.submit(shader);
+        return drawn;
+    }
+
+    // draws the meshlets of every mesh that survive culling against the view frustum and, unless culler.coneCulling
+    // is off, the direction they face (for closed meshes or with back faces culled). viewProjection and
+    // cameraPosition are in world space; the culling runs in each mesh's local space
+    const MeshletCullStats& DrawMeshlets(Shader &shader, const glm::mat4 &viewProjection, const glm::vec3 &cameraPosition, const glm::mat4 &model, MeshletCuller &culler = MeshletCuller::shared())
+    {
+        // planes taken from the full model-view-projection are the frustum's planes in local space
+        Frustum localFrustum(viewProjection * model);
+        glm::vec3 localCamera = glm::vec3(glm::inverse(model) * glm::vec4(cameraPosition, 1.0f));
+        // a mirroring transform turns which side of a triangle is the front around
+        bool cones = glm::determinant(glm::mat3(model)) > 0.0f;
+        meshletStats = MeshletCullStats();
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            Mesh &mesh = meshes[i];
+            if(mesh.lod == 0)
+            {
+                meshletStats += mesh.DrawMeshlets(shader, culler, localFrustum, localCamera, cones);
+                continue;
+            }
+            // the meshlets are full detail; a coarser level goes out whole
+            mesh.Draw(shader);
+            meshletStats.triangles += mesh.lods[0].indexCount / 3;
+            meshletStats.trianglesDrawn += mesh.lods[mesh.lod].indexCount / 3;
+            meshletStats.ranges++;
+            meshletStats.calls++;
+        }
+        return meshletStats;
+    }
+
+    // picks every mesh's level of detail for the draws that follow: the coarsest whose error, placed with the model
+    // matrix and seen from the camera, covers at most pixelThreshold pixels. projectionScale is
+    // lodProjectionScale(camera.Zoom, viewport height)
+    void SelectLods(const glm::mat4 &model, const glm::vec3 &cameraPosition, float projectionScale, float pixelThreshold = 1.0f)
+    {
+        float scale = largestScale(model);
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].lod = selectLod(meshes[i].lods, scale, lodDistance(meshes[i], model, scale, cameraPosition), projectionScale, pixelThreshold);
+    }
+
+    // DrawInstanced with the level picked per instance and mesh: each mesh's instances are grouped by level, and every
+    // group is one upload and one instanced draw. Returns the triangles drawn
+    size_t DrawInstanced(Shader &shader, const glm::mat4 *transforms, size_t count, const glm::vec3 &cameraPosition, float projectionScale, float pixelThreshold = 1.0f)
     {
+        size_t triangles = 0;
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        {
+            Mesh &mesh = meshes[i];
+            if(lodInstances.size() < mesh.lods.size())
+                lodInstances.resize(mesh.lods.size());
+            for(unsigned int level = 0; level < mesh.lods.size(); level++)
+                lodInstances[level].clear();
+            for(size_t t = 0; t < count; t++)
+            {
+                float scale = largestScale(transforms[t]);
+                lodInstances[selectLod(mesh.lods, scale, lodDistance(mesh, transforms[t], scale, cameraPosition), projectionScale, pixelThreshold)].push_back(transforms[t]);
+            }
+            unsigned int selected = mesh.lod;
+            for(unsigned int level = 0; level < mesh.lods.size(); level++)
+            {
+                if(lodInstances[level].empty())
+                    continue;
+                mesh.arena->instances.upload(lodInstances[level].data(), lodInstances[level].size());
+                mesh.lod = level;
+                mesh.DrawInstanced(shader, (GLsizei)lodInstances[level].size());
+                triangles += lodInstances[level].size() * (mesh.lods[level].indexCount / 3);
+            }
+            mesh.lod = selected;
+        }
+        return triangles;
     }
-    
+
 private:
+    MeshletCullStats      meshletStats;
+    // scratch space for the per-instance levels, one list of transforms per level
+    vector<vector<glm::mat4> > lodInstances;
+    // scratch space for the culled Draw, kept to avoid allocating every frame
+    AABBBatch             cullBounds;
+    vector<std::uint64_t> cullVisible;
+
+    // the largest factor the matrix scales by, which is what an error in local units grows to
+    static float largestScale(const glm::mat4 &model)
+    {
+        return glm::sqrt(glm::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])), glm::max(glm::dot(glm::vec3(model[1]), glm::vec3(model[1])), glm::dot(glm::vec3(model[2]), glm::vec3(model[2])))));
+    }
+    // from the camera to the nearest point of the mesh's bounding sphere, 0 inside it
+    static float lodDistance(const Mesh &mesh, const glm::mat4 &model, float scale, const glm::vec3 &cameraPosition)
+    {
+        glm::vec3 center = glm::vec3(model * glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.0f));
+        float radius = glm::length(mesh.boundsMax - mesh.boundsMin) * 0.5f * scale;
+        return glm::max(glm::length(center - cameraPosition) - radius, 0.0f);
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices);
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
@@ -60,6 +264,8 @@ private:
         }
         // retrieve the directory path of the filepath
         directory = path.substr(0, path.find_last_of('/'));
+        // room for every mesh up front, so that the vector doesn't reallocate and move the loaded ones as it grows
+        meshes.reserve(meshes.size() + scene->mNumMeshes);
 
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
@@ -90,7 +296,17 @@ private:
         vector<Vertex> vertices;
         vector<unsigned int> indices;
         vector<Texture> textures;
+        // attributes this mesh has data for; bones are never loaded, and tangents only come with UVs
+        VertexLayout layout = vertexLayout;
+        unsigned int present = VERTEX_POSITION;
+        if (mesh->HasNormals())
+            present |= VERTEX_NORMAL;
+        if (mesh->mTextureCoords[0])
+            present |= VERTEX_TEXCOORDS | VERTEX_TANGENT | VERTEX_BITANGENT;
+        layout.attributes &= present;
 
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(mesh->mNumFaces * 3);
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
@@ -101,6 +317,12 @@ private:
             vector.y = mesh->mVertices[i].y;
             vector.z = mesh->mVertices[i].z;
             vertex.Position = vector;
+            // no bone influences; a skinning loader would fill these in
+            for(unsigned int j = 0; j < MAX_BONE_INFLUENCE; j++)
+            {
+                vertex.m_BoneIDs[j] = -1;
+                vertex.m_Weights[j] = 0.0f;
+            }
             // normals
             if (mesh->HasNormals())
             {
@@ -164,8 +386,24 @@ private:
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
         
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // reorder the triangles for the vertex cache, then by cluster against overdraw (which keeps most of the cache
+        // order), then the vertices for fetch locality
+        cacheBefore += analyzeVertexCache(indices, vertices.size());
+        if (optimizations & MESH_OPTIMIZE_VERTEX_CACHE)
+            optimizeVertexCache(indices, vertices.size());
+        if (optimizations & MESH_OPTIMIZE_OVERDRAW)
+            optimizeOverdraw(indices, vertices);
+        if (optimizations & MESH_OPTIMIZE_VERTEX_FETCH)
+            optimizeVertexFetch(vertices, indices);
+        cacheAfter += analyzeVertexCache(indices, vertices.size());
+
+        // coarser levels go after the full-detail indices, all drawing from the same vertices
+        vector<MeshLod> lods;
+        if (optimizations & MESH_GENERATE_LODS)
+            lods = buildLodChain(indices, vertices);
+
+        // return a mesh object created from the extracted mesh data; the arrays are moved into it, never copied
+        return Mesh(std::move(vertices), std::move(indices), std::move(textures), layout, residency, GeometryArena::shared(), std::move(lods));
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -193,6 +431,7 @@ private:
                 Texture texture;
                 texture.id = TextureFromFile(str.C_Str(), this->directory);
                 texture.type = typeName;
+                texture.role = textureRole(typeName);
                 texture.path = str.C_Str();
                 textures.push_back(texture);
                 textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
@@ -223,7 +462,7 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
         else if (nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLStateCache::bindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
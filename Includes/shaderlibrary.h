@@ -0,0 +1,193 @@
+/*
+Owns a set of named shader programs that are all submitted up front and handed out only once linked, so the driver can compile while the main thread loads models and textures
+*/
+
+#ifndef SHADER_LIBRARY_H
+#define SHADER_LIBRARY_H
+
+#include <glad/glad.h>
+
+#include <shaders.h>
+#include <shadervariants.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <memory>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+class ShaderLibrary
+{
+public:
+    // one span on the startup timeline, in milliseconds since the library was created
+    struct TimelineEvent
+    {
+        std::string label;
+        double start;
+        double end;
+    };
+    std::vector<TimelineEvent> timeline;
+
+    // the loader is only needed to reach glMaxShaderCompilerThreadsKHR, which glad does not load for us
+    ShaderLibrary(GLADloadproc loader = NULL) : created(std::chrono::steady_clock::now())
+    {
+        parallel = Shader::parallelCompileSupported();
+        if (parallel && loader)
+        {
+            typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+            MaxShaderCompilerThreadsProc maxThreads = (MaxShaderCompilerThreadsProc)loader("glMaxShaderCompilerThreadsKHR");
+            if (!maxThreads)
+                maxThreads = (MaxShaderCompilerThreadsProc)loader("glMaxShaderCompilerThreadsARB");
+            // 0xFFFFFFFF lets the implementation pick as many threads as it likes
+            if (maxThreads)
+                maxThreads(0xFFFFFFFF);
+        }
+    }
+    ShaderLibrary(const ShaderLibrary&) = delete;
+    ShaderLibrary& operator=(const ShaderLibrary&) = delete;
+
+    // whether programs really compile in the background, or the fallback path finishes them one per poll()
+    bool parallelCompile() const
+    {
+        return parallel;
+    }
+
+    // submits a program for compilation without waiting for it, with "NAME" or "NAME VALUE" defines if given.
+    // Names are taken once: replacing a program would leave the Shader* already handed out dangling, so a second
+    // add() under the same name is refused and returns false (rebuild in place with Shader::swapProgram instead)
+    bool add(const std::string &name, const char *vertexPath, const char *fragmentPath, const std::vector<std::string> &defines = std::vector<std::string>())
+    {
+        if (!claim(name))
+            return false;
+        double start = elapsed();
+        Entry &entry = programs[name];
+        entry.owned.reset(new Shader(vertexPath, fragmentPath, defines, true));
+        entry.shader = entry.owned.get();
+        submitted(name, entry, start);
+        return true;
+    }
+    // same for one variant of a ShaderVariants, which keeps owning it: a later variants.get() with the same
+    // features returns this program, finished
+    bool add(const std::string &name, ShaderVariants &variants, unsigned int features)
+    {
+        if (!claim(name))
+            return false;
+        double start = elapsed();
+        Entry &entry = programs[name];
+        entry.shader = &variants.get(features, true);
+        submitted(name, entry, start);
+        return true;
+    }
+
+    // finishes every program the driver reports as linked; without parallel compilation there is no way to
+    // tell, so it finishes at most one program per call to spread the blocking across frames or loading steps
+    void poll()
+    {
+        for (std::map<std::string, Entry>::iterator it = programs.begin(); it != programs.end(); ++it)
+        {
+            Shader &shader = *it->second.shader;
+            if (shader.ready() || it->second.failed || !shader.linkComplete())
+                continue;
+            finish(it->first, it->second);
+            if (!parallel)
+                return;
+        }
+    }
+
+    // blocks until every submitted program is finished
+    void waitAll()
+    {
+        for (std::map<std::string, Entry>::iterator it = programs.begin(); it != programs.end(); ++it)
+            if (!it->second.shader->ready() && !it->second.failed)
+                finish(it->first, it->second);
+    }
+
+    // the program if it is linked and ready to use, NULL while it is still compiling (or failed)
+    Shader* get(const std::string &name)
+    {
+        std::map<std::string, Entry>::iterator it = programs.find(name);
+        if (it == programs.end() || !it->second.shader->ready())
+            return NULL;
+        return it->second.shader;
+    }
+
+    bool allReady() const
+    {
+        for (std::map<std::string, Entry>::const_iterator it = programs.begin(); it != programs.end(); ++it)
+            if (!it->second.shader->ready() && !it->second.failed)
+                return false;
+        return true;
+    }
+
+    // milliseconds since the library was created, for callers that want to put their own work on the timeline
+    double elapsed() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - created).count();
+    }
+    void record(const std::string &label, double start, double end)
+    {
+        timeline.push_back({label, start, end});
+    }
+
+    // prints the startup timeline, one bar per event on a shared time axis
+    void printTimeline() const
+    {
+        double total = 0.0;
+        for (unsigned int i = 0; i < timeline.size(); i++)
+            total = std::max(total, timeline[i].end);
+        const int width = 60;
+        std::cout << "startup timeline (" << (parallel ? "parallel compile" : "fallback, no KHR_parallel_shader_compile") << "), " << total << " ms" << std::endl;
+        for (unsigned int i = 0; i < timeline.size(); i++)
+        {
+            const TimelineEvent &event = timeline[i];
+            int from = total > 0.0 ? (int)(event.start / total * width) : 0;
+            int to = total > 0.0 ? (int)(event.end / total * width) : 0;
+            std::string bar(width, ' ');
+            for (int c = from; c <= to && c < width; c++)
+                bar[c] = '#';
+            char line[256];
+            std::snprintf(line, sizeof(line), "  %-32.32s |%s| %8.2f - %8.2f ms", event.label.c_str(), bar.c_str(), event.start, event.end);
+            std::cout << line << std::endl;
+        }
+    }
+
+private:
+    struct Entry
+    {
+        Shader *shader = NULL;
+        std::unique_ptr<Shader> owned; // NULL when a ShaderVariants owns the program
+        double submitted = 0.0;
+        bool failed = false;
+    };
+    std::map<std::string, Entry> programs;
+    std::chrono::steady_clock::time_point created;
+    bool parallel;
+
+    bool claim(const std::string &name)
+    {
+        if (!programs.count(name))
+            return true;
+        std::cout << "ERROR::SHADER_LIBRARY::DUPLICATE_NAME: " << name << std::endl;
+        return false;
+    }
+    void submitted(const std::string &name, Entry &entry, double start)
+    {
+        entry.submitted = elapsed();
+        record("submit " + name, start, entry.submitted);
+        if (entry.shader->loadedFromCache)
+            record(name + " (binary cache)", start, entry.submitted);
+    }
+    void finish(const std::string &name, Entry &entry)
+    {
+        double start = elapsed();
+        // the span between submit and now is the time the driver had to itself
+        record(name + " (driver compile)", entry.submitted, start);
+        entry.shader->finish();
+        entry.failed = !entry.shader->ready();
+        record("finish " + name, start, elapsed());
+    }
+};
+#endif
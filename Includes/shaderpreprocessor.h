@@ -0,0 +1,139 @@
+/*
+A small GLSL preprocessor run before the driver sees the code: expands #include "file" and injects #defines right after the #version line, so shared blocks and feature toggles live in one place
+*/
+
+#ifndef SHADER_PREPROCESSOR_H
+#define SHADER_PREPROCESSOR_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+// directories searched for an #include that is not found next to the including file
+inline std::vector<std::string> SHADER_INCLUDE_DIRS = { "Includes" };
+
+// expanded code plus every file it was built from; the index of a file is its source string number in #line
+// directives, so "2:14(3): error" in a compile log means line 14 of files[2]
+struct ShaderSource
+{
+    std::string code;
+    std::vector<std::string> files;
+};
+
+class ShaderPreprocessor
+{
+public:
+    // expands the file at path; each entry of defines is "NAME" or "NAME VALUE"
+    static ShaderSource process(const std::string &path, const std::vector<std::string> &defines = std::vector<std::string>())
+    {
+        ShaderPreprocessor preprocessor;
+        std::ostringstream out;
+        preprocessor.expand(path, defines, out, 0);
+        preprocessor.source.code = out.str();
+        return preprocessor.source;
+    }
+
+private:
+    ShaderSource source;
+
+    static std::string readFile(const std::string &path)
+    {
+        std::ifstream file;
+        // ensure ifstream objects can throw exceptions:
+        file.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+        try
+        {
+            file.open(path);
+            std::stringstream stream;
+            stream << file.rdbuf();
+            file.close();
+            return stream.str();
+        }
+        catch (std::ifstream::failure& e)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << " " << e.what() << std::endl;
+        }
+        return std::string();
+    }
+    static std::string directoryOf(const std::string &path)
+    {
+        std::string::size_type slash = path.find_last_of('/');
+        return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+    }
+    static bool fileExists(const std::string &path)
+    {
+        std::ifstream file(path);
+        return file.good();
+    }
+    // the including file's directory first, then SHADER_INCLUDE_DIRS
+    static std::string resolve(const std::string &name, const std::string &includer)
+    {
+        std::string local = directoryOf(includer) + name;
+        if (fileExists(local))
+            return local;
+        for (unsigned int i = 0; i < SHADER_INCLUDE_DIRS.size(); i++)
+        {
+            std::string candidate = SHADER_INCLUDE_DIRS[i] + "/" + name;
+            if (fileExists(candidate))
+                return candidate;
+        }
+        return local;
+    }
+
+    bool wasExpanded(const std::string &path) const
+    {
+        for (unsigned int i = 0; i < source.files.size(); i++)
+            if (source.files[i] == path)
+                return true;
+        return false;
+    }
+
+    void expand(const std::string &path, const std::vector<std::string> &defines, std::ostringstream &out, int depth)
+    {
+        int fileIndex = (int)source.files.size();
+        source.files.push_back(path);
+
+        std::istringstream in(readFile(path));
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(in, line))
+        {
+            lineNumber++;
+            std::string::size_type first = line.find_first_not_of(" \t");
+            std::string directive = first == std::string::npos ? std::string() : line.substr(first);
+            if (directive.compare(0, 8, "#include") == 0)
+            {
+                std::string::size_type open = directive.find_first_of("\"<");
+                std::string::size_type close = open == std::string::npos ? open : directive.find_first_of("\">", open + 1);
+                if (close == std::string::npos)
+                {
+                    std::cout << "ERROR::SHADER::MALFORMED_INCLUDE: " << path << ":" << lineNumber << std::endl;
+                    continue;
+                }
+                std::string included = resolve(directive.substr(open + 1, close - open - 1), path);
+                // every include behaves as if guarded: two files can share a block declaration and cycles end here
+                if (wasExpanded(included))
+                {
+                    out << "\n";
+                    continue;
+                }
+                out << "#line 1 " << source.files.size() << "\n";
+                expand(included, std::vector<std::string>(), out, depth + 1);
+                // back to the next line of this file
+                out << "#line " << lineNumber + 1 << " " << fileIndex << "\n";
+                continue;
+            }
+            out << line << "\n";
+            // defines go straight after #version, which has to stay the first statement of the top-level file
+            if (depth == 0 && !defines.empty() && directive.compare(0, 8, "#version") == 0)
+            {
+                for (unsigned int i = 0; i < defines.size(); i++)
+                    out << "#define " << defines[i] << "\n";
+                out << "#line " << lineNumber + 1 << " " << fileIndex << "\n";
+            }
+        }
+    }
+};
+#endif
@@ -8,141 +8,696 @@ This is the abstracted version of Shader stuffs; that mainly creates the ourShad
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <shaderpreprocessor.h>
+#include <glstate.h>
+
 #include <string>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <utility>
+
+// uniform block shared by every program for the per-frame camera data (see frameconstants.h);
+// any program that declares it gets it bound to this binding point right after linking
+const char* const FRAME_CONSTANTS_BLOCK = "FrameConstants";
+const unsigned int FRAME_CONSTANTS_BINDING = 0;
+
+// a uniform location resolved once at link time; the type parameter pins down which setter accepts it,
+// so a handle for a mat4 can never be written with glUniform1i by accident
+template <typename T>
+struct UniformHandle
+{
+    GLint location = -1;
+    int index = -1; // entry in the program's uniform table, which holds the value last uploaded
+    unsigned int generation = 0; // the Shader's generation when it was resolved; after a swapProgram() it is stale
+    bool valid() const { return location >= 0; }
+};
+
+// counters for the uniform path, reset by the render loop once per frame
+struct ShaderStats
+{
+    unsigned int locationQueries = 0; // glGetUniformLocation calls actually issued
+    unsigned int handleWrites = 0;    // writes through a UniformHandle: no string, no hashing, no query
+    unsigned int nameWrites = 0;      // writes by name, served from the reflected table instead of the driver
+    unsigned int skippedUploads = 0;  // writes whose value matched the shadow copy, so no glUniform* was issued
+    unsigned int staleHandleWrites = 0; // writes through a handle resolved before the program was swapped, dropped
+
+    unsigned int lookupsAvoided() const { return handleWrites + nameWrites; }
+};
+
+// per-program upload counters, kept for the lifetime of the program
+struct UniformUploadStats
+{
+    unsigned int uploads = 0;          // glUniform* calls issued
+    unsigned int skippedCalls = 0;     // calls skipped because the value was bitwise identical to the last one
+    unsigned long long skippedBytes = 0;
+};
+
+// GL_KHR_parallel_shader_compile tokens; the bundled glad loader was generated without extensions
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// whether the current context advertises the given extension
+inline bool hasGLExtension(const char *name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char *extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+        if (extension && std::string(extension) == name)
+            return true;
+    }
+    return false;
+}
+
+// on-disk program binaries live here, one file per (sources, defines, driver) key; empty disables the cache
+inline std::string SHADER_CACHE_DIR = ".shadercache";
 
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
-    // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath)
-    {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-        }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
-        }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+    // how this program came to be, for comparing cold and warm startups
+    bool loadedFromCache = false;
+    double buildMilliseconds = 0.0; // main-thread time spent in submit() and finish()
+    // one entry per active uniform (and per array element), filled by reflectUniforms() after linking
+    struct UniformInfo
+    {
+        std::string name;
+        unsigned int hash;
+        GLenum type;
+        GLint size;
+        GLint location;
+        int shadow; // index into the shadow copies, -1 for types that are always uploaded
+    };
+    // what the program was built from, so it can be rebuilt (see ShaderWatcher)
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::vector<std::string> defines;
+    // every file the program was built from, includes and all
+    std::vector<std::string> sourceFiles;
+    // bumped whenever swapProgram() replaces the program; handles resolved against an older generation are stale
+    unsigned int generation = 0;
+    // constructor generates the shader on the fly; with deferLink the compile and link are only submitted
+    // and the caller is expected to call finish() later (see ShaderLibrary)
+    // ------------------------------------------------------------------------
+    Shader(const char* vertexPath, const char* fragmentPath, bool deferLink = false)
+        : Shader(vertexPath, fragmentPath, std::vector<std::string>(), deferLink)
+    {
+    }
+    // same, with "NAME" or "NAME VALUE" defines injected into both stages
+    Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string> &defines, bool deferLink = false)
+    {
+        this->vertexPath = vertexPath;
+        this->fragmentPath = fragmentPath;
+        this->defines = defines;
+        // 1. retrieve the vertex/fragment source code from filePath, expanding #includes
+        ShaderSource vertexSource = ShaderPreprocessor::process(vertexPath, defines);
+        ShaderSource fragmentSource = ShaderPreprocessor::process(fragmentPath, defines);
+        sourceFiles = vertexSource.files;
+        sourceFiles.insert(sourceFiles.end(), fragmentSource.files.begin(), fragmentSource.files.end());
+        std::string definesKey;
+        for (unsigned int i = 0; i < defines.size(); i++)
+            definesKey += defines[i] + "\n";
+        // 2. reuse a cached program binary when the sources and driver are unchanged, else start compiling them
+        submit(vertexSource.code, fragmentSource.code, definesKey);
+        if (!deferLink)
+            finish();
+    }
+    // true when the driver reports the link done, so finish() will not block; without
+    // KHR_parallel_shader_compile there is no way to ask and this always reports true
+    bool linkComplete() const
+    {
+        if (!pending || !parallelCompileSupported())
+            return true;
+        GLint complete = GL_FALSE;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &complete);
+        return complete == GL_TRUE;
+    }
+    // true once finish() has run and the program linked
+    bool ready() const
+    {
+        return !pending && linked;
+    }
+    // checks the compile/link results, stores the binary and reflects the program; blocks if the link is still running
+    // ------------------------------------------------------------------------
+    void finish()
+    {
+        if (!pending)
+            return;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        checkCompileErrors(pendingVertex, "VERTEX");
+        checkCompileErrors(pendingFragment, "FRAGMENT");
+        linked = checkCompileErrors(ID, "PROGRAM");
         // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-
+        glDeleteShader(pendingVertex);
+        glDeleteShader(pendingFragment);
+        pendingVertex = pendingFragment = 0;
+        pending = false;
+        if (linked)
+            storeBinary(pendingKey);
+        // 3. reflect the active uniforms so that nothing has to ask the driver for a location again
+        reflectUniforms();
+        bindUniformBlocks();
+        buildMilliseconds += elapsedSince(start);
+    }
+    // takes over a freshly built program (and its uniform table) in place, so everything holding a reference to
+    // this Shader picks it up; the old program is deleted. Only call between frames.
+    // ------------------------------------------------------------------------
+    void swapProgram(Shader &replacement)
+    {
+        unsigned int nextGeneration = generation + 1;
+        std::swap(*this, replacement);
+        generation = nextGeneration;
+        GLStateCache::forgetProgram(replacement.ID);
+        glDeleteProgram(replacement.ID);
+        replacement.ID = 0;
+    }
+    // KHR_parallel_shader_compile (or its ARB twin) lets the driver compile on its own threads; then the
+    // status queries in finish() are the only point that waits, and GL_COMPLETION_STATUS_KHR can be polled first
+    static bool parallelCompileSupported()
+    {
+        static int supported = -1;
+        if (supported < 0)
+            supported = hasGLExtension("GL_KHR_parallel_shader_compile") || hasGLExtension("GL_ARB_parallel_shader_compile");
+        return supported == 1;
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() const
     { 
-        glUseProgram(ID); 
+        GLStateCache::useProgram(ID); 
+    }
+    // uniform reflection
+    // ------------------------------------------------------------------------
+    // resolves a uniform to a typed handle; meant to be called once, outside the render loop
+    template <typename T>
+    UniformHandle<T> uniform(const char *name) const
+    {
+        UniformHandle<T> handle;
+        handle.generation = generation;
+        const UniformInfo *info = findUniform(name);
+        if (!info)
+            return handle;
+        if (!acceptsType<T>(info->type))
+        {
+            std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH: " << name << std::endl;
+            return handle;
+        }
+        handle.location = info->location;
+        handle.index = (int)(info - uniforms.data());
+        return handle;
+    }
+    // location of a uniform from the reflected table, -1 when it is not active
+    GLint uniformLocation(const char *name) const
+    {
+        const UniformInfo *info = findUniform(name);
+        return info ? info->location : -1;
+    }
+    const std::vector<UniformInfo>& activeUniforms() const
+    {
+        return uniforms;
+    }
+    // per-frame counters shared by every program
+    static ShaderStats& frameStats()
+    {
+        return stats;
+    }
+    static void resetFrameStats()
+    {
+        stats = ShaderStats();
     }
-    // utility uniform functions
+    // what the value shadowing saved this program so far
+    const UniformUploadStats& uploadStats() const
+    {
+        return uploads;
+    }
+    // forgets the last uploaded values; needed after writing this program's uniforms with raw glUniform* calls
+    void invalidateUniformShadow() const
+    {
+        for (unsigned int i = 0; i < shadows.size(); i++)
+            shadows[i].known = false;
+    }
+    // utility uniform functions; a write whose value is bitwise identical to the last one uploaded to this
+    // program is dropped before it reaches the driver
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
-    {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+    {
+        const UniformInfo *info = uniformByName(name);
+        int stored = (int)value;
+        if (changed(info, &stored, sizeof(stored)))
+            glUniform1i(info->location, stored);
+    }
+    void setBool(UniformHandle<bool> handle, bool value) const
+    {
+        int stored = (int)value;
+        if (changed(handle, &stored, sizeof(stored)))
+            glUniform1i(handle.location, stored);
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
-    { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+    {
+        const UniformInfo *info = uniformByName(name);
+        if (changed(info, &value, sizeof(value)))
+            glUniform1i(info->location, value);
+    }
+    void setInt(UniformHandle<int> handle, int value) const
+    {
+        if (changed(handle, &value, sizeof(value)))
+            glUniform1i(handle.location, value);
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
-    { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+    {
+        const UniformInfo *info = uniformByName(name);
+        if (changed(info, &value, sizeof(value)))
+            glUniform1f(info->location, value);
+    }
+    void setFloat(UniformHandle<float> handle, float value) const
+    {
+        if (changed(handle, &value, sizeof(value)))
+            glUniform1f(handle.location, value);
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
-    { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    {
+        const UniformInfo *info = uniformByName(name);
+        if (changed(info, &value[0], sizeof(value)))
+            glUniform2fv(info->location, 1, &value[0]);
     }
     void setVec2(const std::string &name, float x, float y) const
-    { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+    {
+        setVec2(name, glm::vec2(x, y));
+    }
+    void setVec2(UniformHandle<glm::vec2> handle, const glm::vec2 &value) const
+    {
+        if (changed(handle, &value[0], sizeof(value)))
+            glUniform2fv(handle.location, 1, &value[0]);
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
-    { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    {
+        const UniformInfo *info = uniformByName(name);
+        if (changed(info, &value[0], sizeof(value)))
+            glUniform3fv(info->location, 1, &value[0]);
     }
     void setVec3(const std::string &name, float x, float y, float z) const
-    { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+    {
+        setVec3(name, glm::vec3(x, y, z));
+    }
+    void setVec3(UniformHandle<glm::vec3> handle, const glm::vec3 &value) const
+    {
+        if (changed(handle, &value[0], sizeof(value)))
+            glUniform3fv(handle.location, 1, &value[0]);
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
-    { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    {
+        const UniformInfo *info = uniformByName(name);
+        if (changed(info, &value[0], sizeof(value)))
+            glUniform4fv(info->location, 1, &value[0]);
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) const
-    { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+    {
+        setVec4(name, glm::vec4(x, y, z, w));
+    }
+    void setVec4(UniformHandle<glm::vec4> handle, const glm::vec4 &value) const
+    {
+        if (changed(handle, &value[0], sizeof(value)))
+            glUniform4fv(handle.location, 1, &value[0]);
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        const UniformInfo *info = uniformByName(name);
+        if (changed(info, &mat[0][0], sizeof(mat)))
+            glUniformMatrix2fv(info->location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat2(UniformHandle<glm::mat2> handle, const glm::mat2 &mat) const
+    {
+        if (changed(handle, &mat[0][0], sizeof(mat)))
+            glUniformMatrix2fv(handle.location, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        const UniformInfo *info = uniformByName(name);
+        if (changed(info, &mat[0][0], sizeof(mat)))
+            glUniformMatrix3fv(info->location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat3(UniformHandle<glm::mat3> handle, const glm::mat3 &mat) const
+    {
+        if (changed(handle, &mat[0][0], sizeof(mat)))
+            glUniformMatrix3fv(handle.location, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        const UniformInfo *info = uniformByName(name);
+        if (changed(info, &mat[0][0], sizeof(mat)))
+            glUniformMatrix4fv(info->location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat4(UniformHandle<glm::mat4> handle, const glm::mat4 &mat) const
+    {
+        if (changed(handle, &mat[0][0], sizeof(mat)))
+            glUniformMatrix4fv(handle.location, 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    // reflected uniforms plus an open-addressing table of indices into them (-1 marks an empty slot)
+    std::vector<UniformInfo> uniforms;
+    std::vector<int> uniformSlots;
+    static inline ShaderStats stats;
+    // the value last uploaded for each shadowed uniform, packed into one byte array
+    struct UniformShadow
+    {
+        unsigned int offset;
+        unsigned int bytes;
+        bool known; // false until the first upload: a freshly linked program may hold GLSL initializers
+    };
+    mutable std::vector<UniformShadow> shadows;
+    mutable std::vector<unsigned char> shadowValues;
+    mutable UniformUploadStats uploads;
+    mutable bool staleHandleReported = false;
+
+    // FNV-1a over the name, good enough for the handful of uniforms a program has
+    static unsigned int hashName(const char *name)
+    {
+        unsigned int hash = 2166136261u;
+        while (*name)
+        {
+            hash ^= (unsigned char)*name++;
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+    // enumerates the active uniforms once and files them into the hashed table
+    // ------------------------------------------------------------------------
+    void reflectUniforms()
+    {
+        uniforms.clear();
+        shadows.clear();
+        shadowValues.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> buffer(maxLength > 0 ? maxLength : 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLint size;
+            GLenum type;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)buffer.size(), NULL, &size, &type, buffer.data());
+            std::string name(buffer.data());
+            GLint location = glGetUniformLocation(ID, name.c_str());
+            stats.locationQueries++;
+            // members of uniform blocks have no location and are written through their buffer instead
+            if (location < 0)
+                continue;
+            addUniform(name, type, size, location);
+            // arrays are reported as "name[0]"; register the bare name and every element as well
+            std::string::size_type bracket = name.find("[0]");
+            if (bracket != std::string::npos && bracket + 3 == name.size())
+            {
+                std::string base = name.substr(0, bracket);
+                // the bare name is the same uniform as element 0, so they share its shadow copy
+                addUniform(base, type, size, location, uniforms.back().shadow);
+                for (GLint element = 1; element < size; element++)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    GLint elementLocation = glGetUniformLocation(ID, elementName.c_str());
+                    stats.locationQueries++;
+                    addUniform(elementName, type, 1, elementLocation);
+                }
+            }
+        }
+        // keep the table at most half full so probes stay short
+        unsigned int capacity = 8;
+        while (capacity < uniforms.size() * 2)
+            capacity *= 2;
+        uniformSlots.assign(capacity, -1);
+        for (unsigned int i = 0; i < uniforms.size(); i++)
+        {
+            unsigned int slot = uniforms[i].hash & (capacity - 1);
+            while (uniformSlots[slot] != -1)
+                slot = (slot + 1) & (capacity - 1);
+            uniformSlots[slot] = (int)i;
+        }
+    }
+    // attaches the shared blocks this program declares to their fixed binding points
+    void bindUniformBlocks()
+    {
+        GLuint blockIndex = glGetUniformBlockIndex(ID, FRAME_CONSTANTS_BLOCK);
+        if (blockIndex != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, blockIndex, FRAME_CONSTANTS_BINDING);
+    }
+    void addUniform(const std::string &name, GLenum type, GLint size, GLint location)
+    {
+        int shadow = -1;
+        unsigned int bytes = uniformBytes(type);
+        if (bytes > 0)
+        {
+            shadow = (int)shadows.size();
+            shadows.push_back({(unsigned int)shadowValues.size(), bytes, false});
+            shadowValues.resize(shadowValues.size() + bytes);
+        }
+        addUniform(name, type, size, location, shadow);
+    }
+    void addUniform(const std::string &name, GLenum type, GLint size, GLint location, int shadow)
+    {
+        uniforms.push_back({name, hashName(name.c_str()), type, size, location, shadow});
+    }
+    // size of one value as the setters pass it; 0 for types no setter writes, which then skip the shadow
+    static unsigned int uniformBytes(GLenum type);
+    // compares the value with the shadow copy and records it; false means the upload can be skipped
+    template <typename T>
+    bool changed(const UniformHandle<T> &handle, const void *value, unsigned int bytes) const
+    {
+        // its index and location belong to the uniform table swapProgram() replaced: writing through them would
+        // land on some other uniform, so the write is dropped and reported once per program
+        if (handle.generation != generation)
+        {
+            stats.staleHandleWrites++;
+            if (!staleHandleReported)
+            {
+                std::cout << "ERROR::SHADER::STALE_UNIFORM_HANDLE: " << vertexPath << " was rebuilt, resolve its handles again" << std::endl;
+                staleHandleReported = true;
+            }
+            return false;
+        }
+        stats.handleWrites++;
+        // an inactive uniform: glUniform* at location -1 would be a no-op anyway
+        if (handle.index < 0 || handle.index >= (int)uniforms.size())
+            return false;
+        return changed(&uniforms[handle.index], value, bytes);
+    }
+    bool changed(const UniformInfo *info, const void *value, unsigned int bytes) const
+    {
+        if (!info)
+            return false;
+        // a setter of another size than the uniform is a type error the driver reports; leave it to the driver
+        if (info->shadow < 0 || shadows[info->shadow].bytes != bytes)
+        {
+            uploads.uploads++;
+            return true;
+        }
+        UniformShadow &shadow = shadows[info->shadow];
+        unsigned char *last = &shadowValues[shadow.offset];
+        if (shadow.known && std::memcmp(last, value, bytes) == 0)
+        {
+            uploads.skippedCalls++;
+            uploads.skippedBytes += bytes;
+            stats.skippedUploads++;
+            return false;
+        }
+        std::memcpy(last, value, bytes);
+        shadow.known = true;
+        uploads.uploads++;
+        return true;
+    }
+    const UniformInfo* findUniform(const char *name) const
+    {
+        if (uniformSlots.empty())
+            return NULL;
+        unsigned int hash = hashName(name);
+        unsigned int mask = (unsigned int)uniformSlots.size() - 1;
+        for (unsigned int slot = hash & mask; uniformSlots[slot] != -1; slot = (slot + 1) & mask)
+        {
+            const UniformInfo &info = uniforms[uniformSlots[slot]];
+            if (info.hash == hash && info.name == name)
+                return &info;
+        }
+        return NULL;
+    }
+    const UniformInfo* uniformByName(const std::string &name) const
+    {
+        stats.nameWrites++;
+        return findUniform(name.c_str());
+    }
+    // state between submit() and finish()
+    bool pending = false;
+    bool linked = false;
+    unsigned int pendingVertex = 0, pendingFragment = 0;
+    unsigned long long pendingKey = 0;
+
+    static double elapsedSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    // loads the cached binary or issues the compile and link without asking for their status, so a driver
+    // with parallel compilation can keep working while the caller does something else
+    // ------------------------------------------------------------------------
+    void submit(const std::string &vertexCode, const std::string &fragmentCode, const std::string &defines)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        pendingKey = cacheKey(vertexCode, fragmentCode, defines);
+        loadedFromCache = loadBinary(pendingKey);
+        if (loadedFromCache)
+        {
+            linked = true;
+            pending = false;
+            reflectUniforms();
+            bindUniformBlocks();
+            buildMilliseconds += elapsedSince(start);
+            return;
+        }
+        const char *vShaderCode = vertexCode.c_str();
+        const char *fShaderCode = fragmentCode.c_str();
+        // vertex shader
+        pendingVertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(pendingVertex, 1, &vShaderCode, NULL);
+        glCompileShader(pendingVertex);
+        // fragment Shader
+        pendingFragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(pendingFragment, 1, &fShaderCode, NULL);
+        glCompileShader(pendingFragment);
+        // shader Program
+        ID = glCreateProgram();
+        // ask the driver to keep the binary around so it can be written to the cache
+        if (binaryCacheSupported())
+            glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glAttachShader(ID, pendingVertex);
+        glAttachShader(ID, pendingFragment);
+        glLinkProgram(ID);
+        pending = true;
+        buildMilliseconds += elapsedSince(start);
+    }
+    // program binary cache
+    // ------------------------------------------------------------------------
+    // glProgramBinary is core in 4.1; on older contexts glad leaves the entry points null and we always compile
+    static bool binaryCacheSupported()
+    {
+        if (SHADER_CACHE_DIR.empty() || !glGetProgramBinary || !glProgramBinary)
+            return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+    // 64-bit FNV-1a over everything that can change the binary: both sources, the defines and the driver identity
+    static unsigned long long cacheKey(const std::string &vertexCode, const std::string &fragmentCode, const std::string &defines)
+    {
+        unsigned long long hash = 14695981039346656037ull;
+        const char *driver[3] = { (const char*)glGetString(GL_VENDOR), (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION) };
+        const std::string *parts[3] = { &vertexCode, &fragmentCode, &defines };
+        for (int i = 0; i < 6; i++)
+        {
+            const char *text = i < 3 ? parts[i]->c_str() : driver[i - 3];
+            for (; text && *text; text++)
+            {
+                hash ^= (unsigned char)*text;
+                hash *= 1099511628211ull;
+            }
+            // separator, so moving text between the parts changes the key
+            hash ^= 0xff;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+    static std::string cachePath(unsigned long long key)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", key);
+        return SHADER_CACHE_DIR + "/" + name;
+    }
+    // cache file layout: key, binary format, binary length, binary
+    bool loadBinary(unsigned long long key)
+    {
+        if (!binaryCacheSupported())
+            return false;
+        std::ifstream file(cachePath(key), std::ios::binary);
+        if (!file)
+            return false;
+        unsigned long long storedKey = 0;
+        GLenum format = 0;
+        GLint length = 0;
+        file.read((char*)&storedKey, sizeof(storedKey));
+        file.read((char*)&format, sizeof(format));
+        file.read((char*)&length, sizeof(length));
+        if (!file || storedKey != key || length <= 0)
+            return false;
+        // a truncated or corrupt entry could ask for any length: it has to be exactly what the file still holds
+        std::streamoff header = file.tellg();
+        file.seekg(0, std::ios::end);
+        std::streamoff remaining = file.tellg() - header;
+        file.seekg(header);
+        if (remaining != (std::streamoff)length)
+            return false;
+        std::vector<char> binary(length);
+        if (!file.read(binary.data(), length))
+            return false;
+        ID = glCreateProgram();
+        glProgramBinary(ID, format, binary.data(), length);
+        GLint success = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            // the driver rejected it (e.g. after an update it doesn't report in its version string), build from source
+            glDeleteProgram(ID);
+            ID = 0;
+            return false;
+        }
+        return true;
+    }
+    void storeBinary(unsigned long long key) const
+    {
+        if (!binaryCacheSupported())
+            return;
+        GLint length = 0;
+        glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(ID, length, NULL, &format, binary.data());
+        std::error_code error;
+        std::filesystem::create_directories(SHADER_CACHE_DIR, error);
+        // write under a temporary name and rename, so a crash never leaves a truncated entry behind
+        std::string path = cachePath(key);
+        std::string temporary = path + ".tmp";
+        std::ofstream file(temporary, std::ios::binary);
+        if (!file)
+            return;
+        file.write((const char*)&key, sizeof(key));
+        file.write((const char*)&format, sizeof(format));
+        file.write((const char*)&length, sizeof(length));
+        file.write(binary.data(), length);
+        file.close();
+        std::filesystem::rename(temporary, path, error);
+    }
+    // which GLSL uniform types a handle of type T may be written to
+    template <typename T>
+    static bool acceptsType(GLenum type);
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -164,6 +719,53 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success;
     }
 };
+
+template <> inline bool Shader::acceptsType<bool>(GLenum type)      { return type == GL_BOOL; }
+template <> inline bool Shader::acceptsType<float>(GLenum type)     { return type == GL_FLOAT; }
+template <> inline bool Shader::acceptsType<glm::vec2>(GLenum type) { return type == GL_FLOAT_VEC2; }
+template <> inline bool Shader::acceptsType<glm::vec3>(GLenum type) { return type == GL_FLOAT_VEC3; }
+template <> inline bool Shader::acceptsType<glm::vec4>(GLenum type) { return type == GL_FLOAT_VEC4; }
+template <> inline bool Shader::acceptsType<glm::mat2>(GLenum type) { return type == GL_FLOAT_MAT2; }
+template <> inline bool Shader::acceptsType<glm::mat3>(GLenum type) { return type == GL_FLOAT_MAT3; }
+template <> inline bool Shader::acceptsType<glm::mat4>(GLenum type) { return type == GL_FLOAT_MAT4; }
+// samplers are set with glUniform1i, so int handles cover them too
+template <> inline bool Shader::acceptsType<int>(GLenum type)
+{
+    switch (type)
+    {
+    case GL_INT:
+    case GL_BOOL:
+    case GL_SAMPLER_1D:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_3D:
+    case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_2D_SHADOW:
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_2D_ARRAY_SHADOW:
+    case GL_SAMPLER_CUBE_SHADOW:
+    case GL_SAMPLER_2D_MULTISAMPLE:
+    case GL_SAMPLER_BUFFER:
+    case GL_INT_SAMPLER_2D:
+    case GL_UNSIGNED_INT_SAMPLER_2D:
+        return true;
+    default:
+        return false;
+    }
+}
+inline unsigned int Shader::uniformBytes(GLenum type)
+{
+    switch (type)
+    {
+    case GL_FLOAT_VEC2: return 8;
+    case GL_FLOAT_VEC3: return 12;
+    case GL_FLOAT_VEC4: return 16;
+    case GL_FLOAT_MAT2: return 16;
+    case GL_FLOAT_MAT3: return 36;
+    case GL_FLOAT_MAT4: return 64;
+    default:            return type == GL_FLOAT || acceptsType<int>(type) ? 4 : 0;
+    }
+}
 #endif
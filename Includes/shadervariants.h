@@ -0,0 +1,124 @@
+/*
+Feature-specialized versions of one vertex/fragment pair: each feature bit becomes a #define, and a program is compiled the first time a combination is asked for instead of branching on it at runtime in GLSL
+*/
+
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <glad/glad.h>
+
+#include <shaders.h>
+#include <shaderpreprocessor.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <utility>
+#include <filesystem>
+
+// feature bits a material can ask for; bit i turns on SHADER_FEATURE_DEFINES[i]
+enum ShaderFeature
+{
+    SHADER_NORMAL_MAP      = 1 << 0,
+    SHADER_SPECULAR_MAP    = 1 << 1,
+    SHADER_SKINNED         = 1 << 2,
+    SHADER_PACKED_VERTICES = 1 << 3, // the mesh uses one of the packed VertexFormats (see vertexformat.glsl)
+    SHADER_INSTANCED       = 1 << 4  // the model matrix comes per instance (see instancing.glsl)
+};
+const unsigned int SHADER_FEATURE_COUNT = 5;
+const char* const SHADER_FEATURE_DEFINES[SHADER_FEATURE_COUNT] = { "HAS_NORMAL_MAP", "HAS_SPECULAR_MAP", "SKINNED", "PACKED_VERTICES", "INSTANCED" };
+
+class ShaderVariants
+{
+public:
+    // feature bits the sources actually test; the others cannot change the program and are masked off
+    unsigned int usedFeatures;
+
+    // expands the sources once without defines to learn their hash and which features they mention
+    ShaderVariants(const char* vertexPath, const char* fragmentPath) : usedFeatures(0), vertexPath(vertexPath), fragmentPath(fragmentPath)
+    {
+        expand();
+    }
+
+    // the program specialized for the given features, compiled on first use. With deferLink a new variant is only
+    // submitted, like Shader's deferLink, and has to be finish()ed before use (ShaderLibrary does both); without
+    // it a variant still pending is finished here
+    Shader& get(unsigned int features, bool deferLink = false)
+    {
+        refresh();
+        unsigned int effective = features & usedFeatures;
+        VariantKey key(sourceHash, effective);
+        std::map<VariantKey, std::unique_ptr<Shader>>::iterator it = variants.find(key);
+        if (it != variants.end())
+        {
+            if (!deferLink)
+                it->second->finish();
+            return *it->second;
+        }
+        std::vector<std::string> defines;
+        for (unsigned int i = 0; i < SHADER_FEATURE_COUNT; i++)
+            if (effective & (1u << i))
+                defines.push_back(SHADER_FEATURE_DEFINES[i]);
+        Shader *shader = new Shader(vertexPath.c_str(), fragmentPath.c_str(), defines, deferLink);
+        variants[key].reset(shader);
+        return *shader;
+    }
+
+    // number of distinct programs compiled across every ShaderVariants, after deduplication
+    static unsigned int compiledVariants()
+    {
+        return (unsigned int)variants.size();
+    }
+
+private:
+    typedef std::pair<unsigned long long, unsigned int> VariantKey;
+    std::string vertexPath;
+    std::string fragmentPath;
+    unsigned long long sourceHash;
+    // every file the sources expand from, and when each was last written at the time of the hash
+    std::vector<std::string> sourceFiles;
+    std::vector<std::filesystem::file_time_type> sourceTimes;
+    // shared by all instances, so two ShaderVariants over identical sources never compile the same combination twice
+    static inline std::map<VariantKey, std::unique_ptr<Shader>> variants;
+
+    void expand()
+    {
+        ShaderSource vertexSource = ShaderPreprocessor::process(vertexPath);
+        ShaderSource fragmentSource = ShaderPreprocessor::process(fragmentPath);
+        std::string code = vertexSource.code + '\0' + fragmentSource.code;
+        sourceHash = 14695981039346656037ull;
+        for (unsigned int i = 0; i < code.size(); i++)
+        {
+            sourceHash ^= (unsigned char)code[i];
+            sourceHash *= 1099511628211ull;
+        }
+        usedFeatures = 0;
+        for (unsigned int i = 0; i < SHADER_FEATURE_COUNT; i++)
+            if (code.find(SHADER_FEATURE_DEFINES[i]) != std::string::npos)
+                usedFeatures |= 1u << i;
+        sourceFiles = vertexSource.files;
+        sourceFiles.insert(sourceFiles.end(), fragmentSource.files.begin(), fragmentSource.files.end());
+        sourceTimes.resize(sourceFiles.size());
+        for (unsigned int i = 0; i < sourceFiles.size(); i++)
+        {
+            std::error_code error;
+            sourceTimes[i] = std::filesystem::last_write_time(sourceFiles[i], error);
+        }
+    }
+    // the sources may have been edited since (ShaderWatcher reloads them live): the hash and the features they
+    // test are then those of the new sources, so later variants are built from and keyed by what is on disk
+    void refresh()
+    {
+        for (unsigned int i = 0; i < sourceFiles.size(); i++)
+        {
+            std::error_code error;
+            if (std::filesystem::last_write_time(sourceFiles[i], error) != sourceTimes[i])
+            {
+                expand();
+                return;
+            }
+        }
+    }
+};
+#endif
@@ -0,0 +1,205 @@
+/*
+Live shader reloading: a thread watches (with inotify) every file the registered shaders were built from, and the render loop rebuilds and swaps in changed programs at a frame boundary, keeping the old program when the new one fails
+*/
+
+#ifndef SHADER_WATCHER_H
+#define SHADER_WATCHER_H
+
+#include <glad/glad.h>
+
+#include <shaders.h>
+
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+
+class ShaderWatcher
+{
+public:
+    // starts the watcher thread; without inotify the watcher stays inert and update() does nothing
+    ShaderWatcher() : running(true)
+    {
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0)
+        {
+            std::cout << "ERROR::SHADER_WATCHER::INOTIFY_UNAVAILABLE" << std::endl;
+            return;
+        }
+        thread = std::thread(&ShaderWatcher::watchLoop, this);
+    }
+    ~ShaderWatcher()
+    {
+        running = false;
+        if (thread.joinable())
+            thread.join();
+        if (fd >= 0)
+            close(fd);
+    }
+    ShaderWatcher(const ShaderWatcher&) = delete;
+    ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+    // starts watching every source file of the shader; the shader must outlive the watcher
+    void watch(Shader &shader)
+    {
+        for (unsigned int i = 0; i < shaders.size(); i++)
+            if (shaders[i] == &shader)
+                return;
+        shaders.push_back(&shader);
+        watchFiles(shader);
+    }
+
+    // call once per frame, outside of any drawing: starts rebuilds for shaders whose files changed and swaps in
+    // the ones the driver has finished. Rebuilds are submitted with deferLink, so with KHR_parallel_shader_compile
+    // the compile runs on the driver's threads and the render loop never waits on it
+    void update()
+    {
+        std::set<std::string> files;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            files.swap(changed);
+        }
+        if (!files.empty())
+        {
+            for (unsigned int i = 0; i < shaders.size(); i++)
+            {
+                if (!usesAny(*shaders[i], files))
+                    continue;
+                // a rebuild already compiling was submitted with the older source: remember to build again once
+                // it is swapped in or rejected, or this edit would not show up until the next save
+                if (isPending(shaders[i]))
+                    dirty.insert(shaders[i]);
+                else
+                    rebuild(*shaders[i]);
+            }
+        }
+        std::vector<Shader*> resubmit;
+        for (unsigned int i = 0; i < pending.size(); )
+        {
+            Shader &replacement = *pending[i].replacement;
+            if (!replacement.linkComplete())
+            {
+                i++;
+                continue;
+            }
+            replacement.finish();
+            Shader &target = *pending[i].target;
+            if (replacement.ready())
+            {
+                target.swapProgram(replacement);
+                watchFiles(target);
+                std::cout << "reloaded shader " << target.vertexPath << " + " << target.fragmentPath << std::endl;
+            }
+            else
+            {
+                // the compile errors were already printed by finish(); keep drawing with the old program
+                GLStateCache::forgetProgram(replacement.ID);
+                glDeleteProgram(replacement.ID);
+                std::cout << "ERROR::SHADER_WATCHER::RELOAD_FAILED, keeping the previous program: " << target.vertexPath << " + " << target.fragmentPath << std::endl;
+            }
+            if (dirty.erase(&target))
+                resubmit.push_back(&target);
+            pending.erase(pending.begin() + i);
+        }
+        for (unsigned int i = 0; i < resubmit.size(); i++)
+            rebuild(*resubmit[i]);
+    }
+
+private:
+    struct PendingReload
+    {
+        Shader *target;
+        std::unique_ptr<Shader> replacement;
+    };
+    std::vector<Shader*> shaders;
+    std::vector<PendingReload> pending;
+    std::set<Shader*> dirty; // changed again while their rebuild was pending
+
+    int fd;
+    std::thread thread;
+    std::atomic<bool> running;
+    // shared with the watcher thread
+    std::mutex mutex;
+    std::map<int, std::string> directories; // inotify watch descriptor -> watched directory
+    std::set<std::string> changed;          // normalized paths written since the last update()
+
+    static std::string normalize(const std::string &path)
+    {
+        std::error_code error;
+        return std::filesystem::absolute(path, error).lexically_normal().string();
+    }
+
+    // watches directories rather than files, so editors that save by writing a new file and renaming it over
+    // the old one are still noticed
+    void watchFiles(const Shader &shader)
+    {
+        if (fd < 0)
+            return;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (unsigned int i = 0; i < shader.sourceFiles.size(); i++)
+        {
+            std::string directory = std::filesystem::path(normalize(shader.sourceFiles[i])).parent_path().string();
+            int wd = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+            if (wd >= 0)
+                directories[wd] = directory;
+        }
+    }
+    bool isPending(const Shader *shader) const
+    {
+        for (unsigned int i = 0; i < pending.size(); i++)
+            if (pending[i].target == shader)
+                return true;
+        return false;
+    }
+    static bool usesAny(const Shader &shader, const std::set<std::string> &files)
+    {
+        for (unsigned int i = 0; i < shader.sourceFiles.size(); i++)
+            if (files.count(normalize(shader.sourceFiles[i])))
+                return true;
+        return false;
+    }
+    void rebuild(Shader &shader)
+    {
+        PendingReload reload;
+        reload.target = &shader;
+        reload.replacement.reset(new Shader(shader.vertexPath.c_str(), shader.fragmentPath.c_str(), shader.defines, true));
+        pending.push_back(std::move(reload));
+    }
+
+    // runs on the watcher thread: only collects changed paths, all GL work stays on the render thread
+    void watchLoop()
+    {
+        alignas(struct inotify_event) char buffer[4096];
+        while (running)
+        {
+            pollfd descriptor = { fd, POLLIN, 0 };
+            // wake up regularly to notice the destructor asking us to stop
+            if (poll(&descriptor, 1, 100) <= 0)
+                continue;
+            ssize_t length;
+            while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (char *at = buffer; at < buffer + length; )
+                {
+                    const struct inotify_event *event = (const struct inotify_event*)at;
+                    std::map<int, std::string>::iterator directory = directories.find(event->wd);
+                    if (event->len > 0 && directory != directories.end())
+                        changed.insert(directory->second + "/" + event->name);
+                    at += sizeof(struct inotify_event) + event->len;
+                }
+            }
+        }
+    }
+};
+#endif
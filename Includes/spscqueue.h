@@ -0,0 +1,59 @@
+/*
+A fixed-size lock-free ring buffer for exactly one producer thread and one consumer thread: each index is written by one side only, so a push or pop is a couple of atomic loads and one release store
+*/
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+
+// Capacity has to be a power of two; the indices run freely and wrap through the mask
+template <typename T, unsigned int Capacity>
+class SPSCQueue
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SPSCQueue capacity must be a power of two");
+
+public:
+    SPSCQueue() : head(0), tail(0)
+    {
+    }
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+    // producer side; false when the queue is full (the item is not stored)
+    bool push(const T &item)
+    {
+        unsigned int at = head.load(std::memory_order_relaxed);
+        if (at - tail.load(std::memory_order_acquire) == Capacity)
+            return false;
+        slots[at & (Capacity - 1)] = item;
+        // publishes the slot to the consumer
+        head.store(at + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side; false when the queue is empty
+    bool pop(T &item)
+    {
+        unsigned int at = tail.load(std::memory_order_relaxed);
+        if (at == head.load(std::memory_order_acquire))
+            return false;
+        item = slots[at & (Capacity - 1)];
+        // hands the slot back to the producer
+        tail.store(at + 1, std::memory_order_release);
+        return true;
+    }
+
+    // only a snapshot when called while the other side is running
+    unsigned int size() const
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+private:
+    // on separate cache lines, so the two sides don't invalidate each other's index on every operation
+    alignas(64) std::atomic<unsigned int> head; // next slot to write, owned by the producer
+    alignas(64) std::atomic<unsigned int> tail; // next slot to read, owned by the consumer
+    alignas(64) T slots[Capacity];
+};
+#endif
@@ -0,0 +1,52 @@
+/*
+What material textures are for, and the fixed block of sampler units each role owns: Mesh binds its textures there and tools/shadergen.cpp points the generated interfaces' samplers there, so both agree without asking each other
+*/
+
+#ifndef TEXTURE_ROLES_H
+#define TEXTURE_ROLES_H
+
+#include <string>
+#include <cstdlib>
+
+// texture_<role>N sits on unit role * TEXTURE_UNITS_PER_ROLE + N - 1 whichever mesh is drawn, so a program's
+// samplers only need setting once
+enum TextureRole
+{
+    TEXTURE_DIFFUSE,
+    TEXTURE_SPECULAR,
+    TEXTURE_NORMAL,
+    TEXTURE_HEIGHT,
+    TEXTURE_ROLE_COUNT // not a role: textures of an unknown type, which are never bound
+};
+const char* const TEXTURE_ROLE_NAMES[TEXTURE_ROLE_COUNT] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+const unsigned int TEXTURE_UNITS_PER_ROLE = 2;
+// units 0 .. MATERIAL_TEXTURE_UNITS-1 belong to material textures; other samplers get the units after them
+const unsigned int MATERIAL_TEXTURE_UNITS = TEXTURE_ROLE_COUNT * TEXTURE_UNITS_PER_ROLE;
+
+// the role of a Texture::type string
+inline TextureRole textureRole(const std::string &type)
+{
+    for (unsigned int r = 0; r < TEXTURE_ROLE_COUNT; r++)
+        if (type == TEXTURE_ROLE_NAMES[r])
+            return (TextureRole)r;
+    return TEXTURE_ROLE_COUNT;
+}
+
+// the unit of a material sampler uniform (texture_<role>N), or -1 when the name is not one or N is past the role's units
+inline int materialSamplerUnit(const std::string &name)
+{
+    for (unsigned int r = 0; r < TEXTURE_ROLE_COUNT; r++)
+    {
+        std::string prefix = TEXTURE_ROLE_NAMES[r];
+        if (name.compare(0, prefix.size(), prefix) != 0 || name.size() == prefix.size())
+            continue;
+        std::string number = name.substr(prefix.size());
+        if (number.find_first_not_of("0123456789") != std::string::npos)
+            continue;
+        unsigned long n = std::strtoul(number.c_str(), NULL, 10);
+        if (n >= 1 && n <= TEXTURE_UNITS_PER_ROLE)
+            return (int)(r * TEXTURE_UNITS_PER_ROLE + n - 1);
+    }
+    return -1;
+}
+#endif
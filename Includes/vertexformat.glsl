@@ -0,0 +1,44 @@
+// decoding for the packed vertex formats Mesh uploads (VertexFormat in vertexformat.h)
+
+// how the stored positions map back to local space, the identity for VERTEX_FORMAT_FLOAT. These are per-draw
+// inputs rather than uniforms so that every draw of a multi-draw can have its own (DrawBatch): a single draw sets
+// them as constant attribute values, a multi-draw fetches them from an instanced array at the draw's base instance
+layout (location = 7) in vec3 aPositionOffset;
+layout (location = 8) in vec3 aPositionScale;
+
+// positions are stored relative to the mesh's bounds
+vec3 decodePosition(vec3 stored)
+{
+    return aPositionOffset + aPositionScale * stored;
+}
+
+// unit vector from its octahedral projection
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// tangent, bitangent and normal from a unit quaternion whose w sign carries the bitangent's handedness
+mat3 decodeTangentFrame(vec4 q)
+{
+    q = normalize(q);
+    vec3 t = vec3(1.0 - 2.0 * (q.y * q.y + q.z * q.z), 2.0 * (q.x * q.y + q.w * q.z), 2.0 * (q.x * q.z - q.w * q.y));
+    vec3 b = vec3(2.0 * (q.x * q.y - q.w * q.z), 1.0 - 2.0 * (q.x * q.x + q.z * q.z), 2.0 * (q.y * q.z + q.w * q.x));
+    vec3 n = vec3(2.0 * (q.x * q.z + q.w * q.y), 2.0 * (q.y * q.z - q.w * q.x), 1.0 - 2.0 * (q.x * q.x + q.y * q.y));
+    return mat3(t, q.w < 0.0 ? -b : b, n);
+}
+
+// the normal attribute (location 1): three floats, or two snorm16 octahedral components when the program is built
+// with PACKED_VERTICES (SHADER_PACKED_VERTICES)
+vec3 decodeNormal(vec3 stored)
+{
+#ifdef PACKED_VERTICES
+    return decodeOctahedral(stored.xy);
+#else
+    return stored;
+#endif
+}
@@ -0,0 +1,206 @@
+/*
+The vertex as Mesh keeps it on the CPU, the packed formats it can upload instead, and the tables that describe each attribute to GL; shared by Mesh and GeometryArena
+*/
+
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#define MAX_BONE_INFLUENCE 4
+
+struct Vertex {
+    // position
+    glm::vec3 Position;
+    // normal
+    glm::vec3 Normal;
+    // texCoords
+    glm::vec2 TexCoords;
+    // tangent
+    glm::vec3 Tangent;
+    // bitangent
+    glm::vec3 Bitangent;
+	//bone indexes which will influence this vertex
+	int m_BoneIDs[MAX_BONE_INFLUENCE];
+	//weights from each bone
+	float m_Weights[MAX_BONE_INFLUENCE];
+};
+
+// how a Mesh lays its vertices out on the GPU; the CPU copy is always the full-float Vertex above.
+// Shaders read positions through decodePosition() and normals through decodeNormal() from vertexformat.glsl
+enum VertexFormat
+{
+    VERTEX_FORMAT_FLOAT,  // Vertex as it is, 88 bytes
+    VERTEX_FORMAT_HALF,   // PackedVertex with half-float positions relative to the center of the bounds
+    VERTEX_FORMAT_UNORM16 // PackedVertex with unorm16 positions spread across the bounds
+};
+const char* const VERTEX_FORMAT_NAMES[] = { "float", "half", "unorm16" };
+
+// 32 bytes: positions as above, an octahedral normal, a quaternion tangent frame in place of tangent and bitangent,
+// half UVs, and 8-bit bone indices and weights
+struct PackedVertex {
+    uint16_t Position[4];     // xyz, w is padding
+    int16_t  Normal[2];       // octahedral, snorm16
+    uint16_t TexCoords[2];    // half
+    int16_t  TangentFrame[4]; // quaternion, snorm16; w < 0 means the bitangent is flipped
+    uint8_t  m_BoneIDs[MAX_BONE_INFLUENCE];
+    uint8_t  m_Weights[MAX_BONE_INFLUENCE]; // unorm8
+};
+static_assert(sizeof(PackedVertex) == 32, "PackedVertex is meant to be 32 bytes");
+
+// vertex attributes by shader location: bit N is layout (location = N), the same bits as the attributeMask of the
+// programs tools/shadergen.cpp generates
+enum VertexAttribute
+{
+    VERTEX_POSITION       = 1 << 0,
+    VERTEX_NORMAL         = 1 << 1,
+    VERTEX_TEXCOORDS      = 1 << 2,
+    VERTEX_TANGENT        = 1 << 3,
+    VERTEX_BITANGENT      = 1 << 4,
+    VERTEX_BONE_IDS       = 1 << 5,
+    VERTEX_BONE_WEIGHTS   = 1 << 6,
+    VERTEX_ALL_ATTRIBUTES = (1 << 7) - 1
+};
+
+// locations of the two per-draw inputs vertexformat.glsl declares after the vertex attributes: how a mesh's stored
+// positions map back to local space. A single draw sets them as constant attribute values; a multi-draw reads each
+// draw's pair from an instanced array through the base instance (GeometryArena::bindMultiDraw)
+const GLuint DRAW_POSITION_OFFSET_LOCATION = 7;
+const GLuint DRAW_POSITION_SCALE_LOCATION = 8;
+
+// what a Mesh uploads: the format, which attributes to keep (the mesh further drops those its data doesn't have;
+// the position is always kept), and whether positions get a buffer of their own, so that depth-only passes
+// fetch nothing but positions
+struct VertexLayout
+{
+    VertexFormat format = VERTEX_FORMAT_FLOAT;
+    unsigned int attributes = VERTEX_ALL_ATTRIBUTES;
+    bool splitPositions = false;
+};
+
+// one attribute as it sits in a Vertex or PackedVertex, and how the GPU reads it
+struct VertexField
+{
+    unsigned int attributes; // VertexAttribute bits it carries
+    GLuint location;
+    unsigned int offset;     // in the source vertex
+    unsigned int bytes;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    bool integer;            // read with glVertexAttribIPointer
+};
+
+// the attributes of a format, position first
+inline std::vector<VertexField> vertexFields(VertexFormat format)
+{
+    if (format == VERTEX_FORMAT_FLOAT)
+        return {
+            { VERTEX_POSITION,     0, offsetof(Vertex, Position),  12, 3, GL_FLOAT, GL_FALSE, false },
+            { VERTEX_NORMAL,       1, offsetof(Vertex, Normal),    12, 3, GL_FLOAT, GL_FALSE, false },
+            { VERTEX_TEXCOORDS,    2, offsetof(Vertex, TexCoords),  8, 2, GL_FLOAT, GL_FALSE, false },
+            { VERTEX_TANGENT,      3, offsetof(Vertex, Tangent),   12, 3, GL_FLOAT, GL_FALSE, false },
+            { VERTEX_BITANGENT,    4, offsetof(Vertex, Bitangent), 12, 3, GL_FLOAT, GL_FALSE, false },
+            { VERTEX_BONE_IDS,     5, offsetof(Vertex, m_BoneIDs), 16, 4, GL_INT,   GL_FALSE, true  },
+            { VERTEX_BONE_WEIGHTS, 6, offsetof(Vertex, m_Weights), 16, 4, GL_FLOAT, GL_FALSE, false }
+        };
+    GLenum positionType = format == VERTEX_FORMAT_HALF ? GL_HALF_FLOAT : GL_UNSIGNED_SHORT;
+    return {
+        { VERTEX_POSITION,     0, offsetof(PackedVertex, Position),     8, 3, positionType,     format == VERTEX_FORMAT_UNORM16, false },
+        { VERTEX_NORMAL,       1, offsetof(PackedVertex, Normal),       4, 2, GL_SHORT,         GL_TRUE,  false },
+        { VERTEX_TEXCOORDS,    2, offsetof(PackedVertex, TexCoords),    4, 2, GL_HALF_FLOAT,    GL_FALSE, false },
+        // one quaternion stands in for both; location 4 stays disabled and decodeTangentFrame() rebuilds the bitangent
+        { VERTEX_TANGENT | VERTEX_BITANGENT, 3, offsetof(PackedVertex, TangentFrame), 8, 4, GL_SHORT, GL_TRUE, false },
+        { VERTEX_BONE_IDS,     5, offsetof(PackedVertex, m_BoneIDs),    4, 4, GL_UNSIGNED_BYTE, GL_FALSE, true  },
+        { VERTEX_BONE_WEIGHTS, 6, offsetof(PackedVertex, m_Weights),    4, 4, GL_UNSIGNED_BYTE, GL_TRUE,  false }
+    };
+}
+
+// size of one vertex on the GPU, summed over all its streams
+inline unsigned int vertexStride(VertexFormat format, unsigned int attributes = VERTEX_ALL_ATTRIBUTES)
+{
+    std::vector<VertexField> fields = vertexFields(format);
+    unsigned int stride = 0;
+    for (unsigned int i = 0; i < fields.size(); i++)
+        if (fields[i].attributes & (attributes | VERTEX_POSITION))
+            stride += fields[i].bytes;
+    return stride;
+}
+
+// projects a unit vector onto the octahedron and unfolds it into [-1, 1]^2
+inline glm::vec2 encodeOctahedral(glm::vec3 n)
+{
+    n /= glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z);
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0.0f)
+    {
+        e.x = (1.0f - glm::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        e.y = (1.0f - glm::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return e;
+}
+
+// the rotation taking x/y/z to tangent/bitangent/normal, with w made negative for a mirrored bitangent
+inline glm::quat encodeTangentFrame(glm::vec3 normal, glm::vec3 tangent, glm::vec3 bitangent)
+{
+    glm::vec3 n = glm::normalize(normal);
+    glm::vec3 t = tangent - n * glm::dot(n, tangent);
+    // meshes without UVs have no tangents; any vector perpendicular to the normal will do
+    if (glm::dot(t, t) < 1e-12f)
+        t = glm::cross(n, glm::abs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f));
+    t = glm::normalize(t);
+    glm::vec3 b = glm::cross(n, t);
+    bool mirrored = glm::dot(b, bitangent) < 0.0f;
+    glm::quat q = glm::normalize(glm::quat_cast(glm::mat3(t, b, n)));
+    if (q.w < 0.0f)
+        q = -q;
+    // snorm16 has no -0, so w is kept at least one step away from zero for its sign to survive
+    const float bias = 1.0f / 32767.0f;
+    if (q.w < bias)
+    {
+        float scale = glm::sqrt(1.0f - bias * bias) / glm::length(glm::vec3(q.x, q.y, q.z));
+        q = glm::quat(bias, q.x * scale, q.y * scale, q.z * scale);
+    }
+    return mirrored ? -q : q;
+}
+
+// the narrowest index type that can address every vertex of a mesh. 8-bit indices are only picked for meshes that
+// small, where the few bytes don't matter either way (some GPUs widen them on the fly)
+inline GLenum indexTypeFor(size_t vertexCount)
+{
+    if (vertexCount <= 256)
+        return GL_UNSIGNED_BYTE;
+    if (vertexCount <= 65536)
+        return GL_UNSIGNED_SHORT;
+    return GL_UNSIGNED_INT;
+}
+inline unsigned int indexSize(GLenum type)
+{
+    return type == GL_UNSIGNED_BYTE ? 1 : type == GL_UNSIGNED_SHORT ? 2 : 4;
+}
+
+// copies 32-bit indices into a narrower type for upload
+template <typename T>
+std::vector<T> narrowIndices(const std::vector<unsigned int> &indices)
+{
+    return std::vector<T>(indices.begin(), indices.end());
+}
+
+// attribute pointer into the bound array buffer, for the bound VAO; normalized attributes read as [0, 1] / [-1, 1] floats
+inline void pointVertexField(const VertexField &field, unsigned int stride, size_t offset)
+{
+    glEnableVertexAttribArray(field.location);
+    if (field.integer)
+        glVertexAttribIPointer(field.location, field.size, field.type, stride, (void*)offset);
+    else
+        glVertexAttribPointer(field.location, field.size, field.type, field.normalized, stride, (void*)offset);
+}
+#endif
@@ -1,4 +1,10 @@
 #!/usr/bin/bash
+# the generated shader interfaces (tools/shaderprograms.txt) have to match the GLSL, or the build stops here
+g++ -std=c++17 -I Includes tools/shadergen.cpp -o shadergen || exit 1
+./shadergen --check tools/shaderprograms.txt
+status=$?
+rm shadergen
+[ $status -eq 0 ] || exit 1
 g++ -I Includes $1 Sources/glad.c Sources/stbimage.c -o glout -Wall -lGL -lGLU -lglut -lGLEW -lglfw -lX11 -lXxf86vm -lXrandr -lpthread -lXi -ldl -lXinerama -lXcursor -lm -lassimp
-./glout
+./glout "${@:2}"
 rm glout
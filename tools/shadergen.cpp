@@ -0,0 +1,534 @@
+/*
+Generates a typed C++ interface per shader program from its GLSL: one setter per uniform, fixed texture units for the samplers and the vertex input locations, so the C++ side never spells a uniform name.
+Programs are listed in tools/shaderprograms.txt. Run from the repository root:
+
+    g++ -std=c++17 -I Includes tools/shadergen.cpp -o shadergen
+    ./shadergen tools/shaderprograms.txt          rewrites the headers
+    ./shadergen --check tools/shaderprograms.txt  exits with 1 if any header is out of date (rungl.sh runs this)
+*/
+
+#include <shaderpreprocessor.h>
+#include <textureroles.h>
+
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cctype>
+#include <cstdlib>
+
+// one line of the program list
+struct ProgramEntry
+{
+    std::string name;
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::string headerPath;
+};
+
+struct UniformDecl
+{
+    std::string glslType;
+    std::string name;
+    int arraySize; // 0 when not an array
+};
+
+struct AttributeDecl
+{
+    std::string name;
+    int location;
+    int locations; // how many consecutive locations it takes: one per matrix column and array element
+};
+
+// vertex attributes take locations 0-6 (VertexAttribute in vertexformat.h); the inputs above them, the per-draw
+// position decoding and the instance matrix, come from the arena and instance buffers rather than the mesh
+const int VERTEX_ATTRIBUTE_LOCATIONS = 7;
+
+// how a GLSL uniform type is written from C++
+struct TypeMapping
+{
+    const char *glsl;
+    const char *cpp;
+    const char *setter;
+};
+const TypeMapping TYPE_MAPPINGS[] =
+{
+    { "bool",  "bool",      "setBool"  },
+    { "int",   "int",       "setInt"   },
+    { "float", "float",     "setFloat" },
+    { "vec2",  "glm::vec2", "setVec2"  },
+    { "vec3",  "glm::vec3", "setVec3"  },
+    { "vec4",  "glm::vec4", "setVec4"  },
+    { "mat2",  "glm::mat2", "setMat2"  },
+    { "mat3",  "glm::mat3", "setMat3"  },
+    { "mat4",  "glm::mat4", "setMat4"  },
+};
+
+static bool failed = false;
+
+static void error(const std::string &message)
+{
+    std::cout << "ERROR::SHADERGEN::" << message << std::endl;
+    failed = true;
+}
+
+static const TypeMapping* mappingFor(const std::string &glslType)
+{
+    for (unsigned int i = 0; i < sizeof(TYPE_MAPPINGS) / sizeof(TYPE_MAPPINGS[0]); i++)
+        if (glslType == TYPE_MAPPINGS[i].glsl)
+            return &TYPE_MAPPINGS[i];
+    return NULL;
+}
+
+static bool isSampler(const std::string &glslType)
+{
+    return glslType.find("sampler") != std::string::npos;
+}
+
+// locations one vertex input of this type takes: a matrix takes one per column
+static int locationsOf(const std::string &glslType)
+{
+    if (glslType.compare(0, 3, "mat") == 0 || glslType.compare(0, 4, "dmat") == 0)
+    {
+        std::string::size_type digit = glslType.find_first_of("234");
+        if (digit != std::string::npos)
+            return glslType[digit] - '0';
+    }
+    return 1;
+}
+
+// one open #if/#ifdef/#ifndef: whether its lines are compiled, and whether any of its branches was
+struct Conditional
+{
+    bool enclosingActive;
+    bool taken;
+    bool active;
+};
+
+// the value of the condition of an #if or #elif; only defined(NAME), defined NAME, their negation and the
+// literals 0 and 1 are understood, which is all the repository's shaders use
+static bool evaluateCondition(const std::string &expression, const std::set<std::string> &defined)
+{
+    std::istringstream in(expression);
+    std::string word;
+    in >> word;
+    bool negate = false;
+    if (!word.empty() && word[0] == '!')
+    {
+        negate = true;
+        word = word.substr(1);
+    }
+    if (word == "0" || word == "1")
+        return (word == "1") != negate;
+    if (word.compare(0, 7, "defined") == 0)
+    {
+        std::string name = word.substr(7);
+        if (name.empty())
+            in >> name;
+        std::string clean;
+        for (unsigned int i = 0; i < name.size(); i++)
+            if (name[i] != '(' && name[i] != ')')
+                clean += name[i];
+        return (defined.count(clean) > 0) != negate;
+    }
+    error("UNSUPPORTED_CONDITIONAL: #if " + expression);
+    return false;
+}
+
+// follows one preprocessor directive: conditionals open, flip and close branches, and #define and #undef within
+// compiled lines change what is defined
+static void applyDirective(const std::string &line, std::vector<Conditional> &conditionals, std::set<std::string> &defined)
+{
+    std::istringstream in(line.substr(line.find('#') + 1));
+    std::string directive, name;
+    in >> directive;
+    std::string rest;
+    std::getline(in, rest);
+    std::string::size_type comment = rest.find("//");
+    if (comment != std::string::npos)
+        rest.erase(comment);
+    std::istringstream(rest) >> name;
+    bool active = conditionals.empty() || conditionals.back().active;
+    if (directive == "ifdef" || directive == "ifndef" || directive == "if")
+    {
+        bool condition = directive == "if" ? evaluateCondition(rest, defined) : (defined.count(name) > 0) == (directive == "ifdef");
+        conditionals.push_back({ active, active && condition, active && condition });
+    }
+    else if (directive == "elif" || directive == "else")
+    {
+        if (conditionals.empty())
+        {
+            error("UNMATCHED_DIRECTIVE: #" + directive);
+            return;
+        }
+        Conditional &open = conditionals.back();
+        bool condition = directive == "else" || evaluateCondition(rest, defined);
+        open.active = open.enclosingActive && !open.taken && condition;
+        open.taken = open.taken || open.active;
+    }
+    else if (directive == "endif")
+    {
+        if (conditionals.empty())
+            error("UNMATCHED_DIRECTIVE: #endif");
+        else
+            conditionals.pop_back();
+    }
+    else if (directive == "define" && active)
+        defined.insert(name);
+    else if (directive == "undef" && active)
+        defined.erase(name);
+}
+
+// strips comments and preprocessor lines (the preprocessor has already expanded the includes) and splits the
+// rest into identifiers, numbers and single punctuation characters. Conditionals are evaluated as for a build
+// without defines, so only the declarations that program really has are reflected
+static std::vector<std::string> tokenize(const std::string &code)
+{
+    std::vector<std::string> tokens;
+    std::vector<Conditional> conditionals;
+    std::set<std::string> defined;
+    bool lineStart = true;
+    for (std::string::size_type i = 0; i < code.size(); )
+    {
+        char c = code[i];
+        if (c == '\n')
+        {
+            lineStart = true;
+            i++;
+            continue;
+        }
+        if (std::isspace((unsigned char)c))
+        {
+            i++;
+            continue;
+        }
+        if (lineStart && c == '#')
+        {
+            std::string::size_type end = code.find('\n', i);
+            applyDirective(code.substr(i, end == std::string::npos ? std::string::npos : end - i), conditionals, defined);
+            i = end;
+            if (i == std::string::npos)
+                break;
+            continue;
+        }
+        if (code.compare(i, 2, "//") == 0)
+        {
+            i = code.find('\n', i);
+            if (i == std::string::npos)
+                break;
+            continue;
+        }
+        lineStart = false;
+        if (code.compare(i, 2, "/*") == 0)
+        {
+            i = code.find("*/", i + 2);
+            if (i == std::string::npos)
+                break;
+            i += 2;
+            continue;
+        }
+        bool active = conditionals.empty() || conditionals.back().active;
+        if (std::isalnum((unsigned char)c) || c == '_')
+        {
+            std::string::size_type start = i;
+            while (i < code.size() && (std::isalnum((unsigned char)code[i]) || code[i] == '_' || code[i] == '.'))
+                i++;
+            if (active)
+                tokens.push_back(code.substr(start, i - start));
+            continue;
+        }
+        if (active)
+            tokens.push_back(std::string(1, c));
+        i++;
+    }
+    if (!conditionals.empty())
+        error("UNTERMINATED_CONDITIONAL");
+    return tokens;
+}
+
+// reads the global declarations of one stage; blocks and function bodies are skipped as a whole
+static void parseStage(const std::string &path, bool vertexStage, std::vector<UniformDecl> &uniforms, std::vector<AttributeDecl> &attributes)
+{
+    ShaderSource source = ShaderPreprocessor::process(path);
+    std::vector<std::string> tokens = tokenize(source.code);
+    std::vector<std::string> declaration;
+    for (unsigned int i = 0; i < tokens.size(); i++)
+    {
+        if (tokens[i] == "{")
+        {
+            // a function body or an interface block (uniform blocks go through their buffer, not setters)
+            int depth = 0;
+            for (; i < tokens.size(); i++)
+            {
+                if (tokens[i] == "{")
+                    depth++;
+                else if (tokens[i] == "}" && --depth == 0)
+                    break;
+            }
+            // whatever follows up to the ';' is an instance name
+            declaration.clear();
+            declaration.push_back("}");
+            continue;
+        }
+        if (tokens[i] != ";")
+        {
+            declaration.push_back(tokens[i]);
+            continue;
+        }
+        std::vector<std::string> tokensOf;
+        tokensOf.swap(declaration);
+        if (tokensOf.empty() || tokensOf[0] == "}")
+            continue;
+
+        // layout (location = N, ...)
+        int location = -1;
+        unsigned int at = 0;
+        if (tokensOf[0] == "layout")
+        {
+            for (at = 1; at < tokensOf.size() && tokensOf[at] != ")"; at++)
+                if (tokensOf[at] == "location" && at + 2 < tokensOf.size() && tokensOf[at + 1] == "=")
+                    location = std::atoi(tokensOf[at + 2].c_str());
+            at++;
+        }
+        bool uniform = false, input = false;
+        for (; at < tokensOf.size(); at++)
+        {
+            const std::string &word = tokensOf[at];
+            if (word == "uniform")
+                uniform = true;
+            else if (word == "in")
+                input = true;
+            else if (word != "flat" && word != "smooth" && word != "noperspective" && word != "highp" && word != "mediump" && word != "lowp")
+                break;
+        }
+        if ((!uniform && !(input && vertexStage)) || at >= tokensOf.size())
+            continue;
+        std::string type = tokensOf[at++];
+        // comma separated names, each optionally an array
+        while (at < tokensOf.size())
+        {
+            UniformDecl decl = { type, tokensOf[at++], 0 };
+            if (at < tokensOf.size() && tokensOf[at] == "[")
+            {
+                decl.arraySize = at + 1 < tokensOf.size() ? std::atoi(tokensOf[at + 1].c_str()) : 0;
+                if (decl.arraySize <= 0)
+                    error("ARRAY_SIZE_NOT_A_NUMBER: " + decl.name + " in " + path);
+                at += 3;
+            }
+            if (uniform)
+            {
+                bool known = false;
+                for (unsigned int u = 0; u < uniforms.size(); u++)
+                {
+                    if (uniforms[u].name != decl.name)
+                        continue;
+                    known = true;
+                    if (uniforms[u].glslType != decl.glslType || uniforms[u].arraySize != decl.arraySize)
+                        error("STAGES_DISAGREE: " + decl.name + " is declared with different types in " + path);
+                }
+                if (!known)
+                    uniforms.push_back(decl);
+            }
+            else
+            {
+                if (location < 0)
+                    error("NO_EXPLICIT_LOCATION: vertex input " + decl.name + " in " + path);
+                attributes.push_back({ decl.name, location, locationsOf(type) * std::max(decl.arraySize, 1) });
+            }
+            if (at < tokensOf.size() && tokensOf[at] == ",")
+                at++;
+            else
+                break;
+        }
+    }
+}
+
+static std::string capitalize(const std::string &name)
+{
+    std::string result = name;
+    if (!result.empty())
+        result[0] = (char)std::toupper((unsigned char)result[0]);
+    return result;
+}
+
+static std::string upper(const std::string &name)
+{
+    std::string result;
+    for (unsigned int i = 0; i < name.size(); i++)
+    {
+        if (i > 0 && std::isupper((unsigned char)name[i]) && std::islower((unsigned char)name[i - 1]))
+            result += '_';
+        result += (char)std::toupper((unsigned char)name[i]);
+    }
+    return result;
+}
+
+static std::string generate(const ProgramEntry &program)
+{
+    std::vector<UniformDecl> uniforms;
+    std::vector<AttributeDecl> attributes;
+    std::vector<AttributeDecl> unused;
+    parseStage(program.vertexPath, true, uniforms, attributes);
+    parseStage(program.fragmentPath, false, uniforms, unused);
+
+    std::string className = program.name + "Program";
+    std::ostringstream out;
+    out << "// Generated by tools/shadergen.cpp from " << program.vertexPath << " and " << program.fragmentPath << "; do not edit.\n";
+    out << "// After changing the GLSL, rerun ./shadergen tools/shaderprograms.txt from the repository root.\n\n";
+    out << "#ifndef " << upper(className) << "_H\n";
+    out << "#define " << upper(className) << "_H\n\n";
+    out << "#include <glad/glad.h>\n#include <glm/glm.hpp>\n\n#include <shaders.h>\n\n";
+    out << "// typed interface of the " << program.name << " program: the handles are resolved once per link, so nothing\n";
+    out << "// in the draw path spells or hashes a uniform name\n";
+    out << "class " << className << "\n{\npublic:\n";
+    if (!attributes.empty())
+    {
+        out << "    // vertex inputs, from their layout (location = N) qualifiers\n";
+        for (unsigned int i = 0; i < attributes.size(); i++)
+            out << "    static const GLuint " << attributes[i].name << "Location = " << attributes[i].location << ";\n";
+        unsigned int mask = 0;
+        for (unsigned int i = 0; i < attributes.size(); i++)
+            for (int location = attributes[i].location; location >= 0 && location < attributes[i].location + attributes[i].locations; location++)
+                if (location < VERTEX_ATTRIBUTE_LOCATIONS)
+                    mask |= 1u << location;
+        out << "    // bit N for every vertex attribute above (locations below " << VERTEX_ATTRIBUTE_LOCATIONS << ", VertexAttribute in vertexformat.h); meshes\n";
+        out << "    // built for this program can leave the other attributes out\n";
+        out << "    static const unsigned int attributeMask = 0x" << std::hex << mask << std::dec << ";\n";
+    }
+    // material samplers (texture_diffuse1, ...) sit on their role's unit, as Mesh binds them; the others follow
+    unsigned int unit = MATERIAL_TEXTURE_UNITS;
+    bool anySampler = false;
+    for (unsigned int i = 0; i < uniforms.size(); i++)
+    {
+        if (!isSampler(uniforms[i].glslType))
+            continue;
+        if (uniforms[i].arraySize > 0)
+        {
+            error("SAMPLER_ARRAYS_UNSUPPORTED: " + uniforms[i].name);
+            continue;
+        }
+        if (!anySampler)
+            out << "    // texture unit of each sampler: material textures on their role's unit (textureroles.h), the others in\n    // declaration order after those; bind() points the samplers at them\n";
+        anySampler = true;
+        int materialUnit = materialSamplerUnit(uniforms[i].name);
+        out << "    static const GLuint " << uniforms[i].name << "Unit = " << (materialUnit >= 0 ? (unsigned int)materialUnit : unit++) << ";\n";
+    }
+    out << "\n    Shader &shader;\n\n";
+    out << "    explicit " << className << "(Shader &shader) : shader(shader)\n    {\n        bind();\n    }\n\n";
+    out << "    // activates the program, resolving the handles again first if it was rebuilt (see ShaderWatcher)\n";
+    out << "    void use()\n    {\n        if (generation != shader.generation)\n            bind();\n        shader.use();\n    }\n";
+    for (unsigned int i = 0; i < uniforms.size(); i++)
+    {
+        const UniformDecl &uniform = uniforms[i];
+        if (isSampler(uniform.glslType))
+            continue;
+        const TypeMapping *mapping = mappingFor(uniform.glslType);
+        if (!mapping)
+        {
+            error("UNSUPPORTED_UNIFORM_TYPE: " + uniform.glslType + " " + uniform.name);
+            continue;
+        }
+        out << "    void set" << capitalize(uniform.name) << "(";
+        if (uniform.arraySize > 0)
+            out << "unsigned int index, ";
+        out << "const " << mapping->cpp << " &value) const\n    {\n";
+        out << "        shader." << mapping->setter << "(" << uniform.name << (uniform.arraySize > 0 ? "[index]" : "") << ", value);\n    }\n";
+    }
+    out << "\nprivate:\n    unsigned int generation;\n";
+    for (unsigned int i = 0; i < uniforms.size(); i++)
+    {
+        const UniformDecl &uniform = uniforms[i];
+        const TypeMapping *mapping = isSampler(uniform.glslType) ? mappingFor("int") : mappingFor(uniform.glslType);
+        if (!mapping || (isSampler(uniform.glslType) && uniform.arraySize > 0))
+            continue;
+        out << "    UniformHandle<" << mapping->cpp << "> " << uniform.name;
+        if (uniform.arraySize > 0)
+            out << "[" << uniform.arraySize << "]";
+        out << ";\n";
+    }
+    out << "\n    void bind()\n    {\n        generation = shader.generation;\n";
+    for (unsigned int i = 0; i < uniforms.size(); i++)
+    {
+        const UniformDecl &uniform = uniforms[i];
+        const TypeMapping *mapping = isSampler(uniform.glslType) ? mappingFor("int") : mappingFor(uniform.glslType);
+        if (!mapping || (isSampler(uniform.glslType) && uniform.arraySize > 0))
+            continue;
+        if (uniform.arraySize > 0)
+        {
+            out << "        for (unsigned int i = 0; i < " << uniform.arraySize << "; i++)\n";
+            out << "            " << uniform.name << "[i] = shader.uniform<" << mapping->cpp << ">((\"" << uniform.name << "[\" + std::to_string(i) + \"]\").c_str());\n";
+        }
+        else
+            out << "        " << uniform.name << " = shader.uniform<" << mapping->cpp << ">(\"" << uniform.name << "\");\n";
+    }
+    if (anySampler)
+    {
+        out << "        shader.use();\n";
+        for (unsigned int i = 0; i < uniforms.size(); i++)
+            if (isSampler(uniforms[i].glslType) && uniforms[i].arraySize == 0)
+                out << "        shader.setInt(" << uniforms[i].name << ", " << uniforms[i].name << "Unit);\n";
+    }
+    out << "    }\n};\n#endif\n";
+    return out.str();
+}
+
+static std::vector<ProgramEntry> readProgramList(const std::string &path)
+{
+    std::vector<ProgramEntry> programs;
+    std::ifstream file(path);
+    if (!file)
+    {
+        error("PROGRAM_LIST_NOT_FOUND: " + path);
+        return programs;
+    }
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::string::size_type first = line.find_first_not_of(" \t");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+        std::istringstream fields(line);
+        ProgramEntry entry;
+        if (!(fields >> entry.name >> entry.vertexPath >> entry.fragmentPath >> entry.headerPath))
+        {
+            error("MALFORMED_PROGRAM_LIST_LINE: " + line);
+            continue;
+        }
+        programs.push_back(entry);
+    }
+    return programs;
+}
+
+int main(int argc, char **argv)
+{
+    bool check = argc > 1 && std::string(argv[1]) == "--check";
+    if (argc != (check ? 3 : 2))
+    {
+        std::cout << "usage: shadergen [--check] tools/shaderprograms.txt" << std::endl;
+        return 2;
+    }
+    std::vector<ProgramEntry> programs = readProgramList(argv[check ? 2 : 1]);
+    for (unsigned int i = 0; i < programs.size(); i++)
+    {
+        std::string header = generate(programs[i]);
+        if (failed)
+            break;
+        std::ifstream existing(programs[i].headerPath);
+        std::stringstream current;
+        current << existing.rdbuf();
+        if (current.str() == header)
+            continue;
+        if (check)
+        {
+            error("OUT_OF_DATE: " + programs[i].headerPath + " no longer matches " + programs[i].vertexPath + " / " + programs[i].fragmentPath + ", rerun ./shadergen tools/shaderprograms.txt");
+            continue;
+        }
+        std::ofstream file(programs[i].headerPath);
+        file << header;
+        std::cout << "wrote " << programs[i].headerPath << std::endl;
+    }
+    return failed ? 1 : 0;
+}